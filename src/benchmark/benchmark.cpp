@@ -0,0 +1,364 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include "../detector/detector.h"
+#include "../detector/simd.h"
+#include "../trace/trace.h"
+#include "stats.h"
+
+using namespace std;
+
+// Benchmark [--kernels a,b] [--sizes WxH,..] [--filters prewitt3,..] [--areas 1,2]
+//           [--threads 1,4] [--scaling N] [--warmup N] [--reps N] [--label text] [--json file] [--csv file]
+//
+// Every kernel runs on a synthetic image for each size, filter, area and
+// thread count: warm-up runs first, then reps timed runs, summarized with
+// outliers removed. The sweeps are also given as a multiple of one run of
+// prewitt-simd or edge-simd when those ran too. Kernels that do not use the
+// filter or the area are only run for the first one. Each configuration gets a fresh Detector, so kernel
+// variants never carry over from the previous kernel; the variants that ran
+// are reported with the results. Each thread count runs in its own task_arena
+// under a global_control limit.
+//
+// --scaling N replaces the thread list with 1..N (0: every hardware thread)
+// and prints speedup, efficiency and the Karp-Flatt serial fraction per
+// configuration, plus the thread count where the speedup flattens.
+
+struct buffers {
+    int width;
+    int height;
+    vector<pixel> input;
+    vector<pixel> first;
+    vector<pixel> second;
+    vector<gradient> magnitude;
+    threshold_sweep sweep;
+};
+
+// setup runs once per configuration, untimed, before the warm-up. A case
+// with a baseline is also reported as a multiple of that kernel's time.
+struct benchmark_case {
+    string name;
+    string baseline;
+    bool uses_filter;
+    bool uses_area;
+    bool uses_prewitt_variant;
+    bool uses_edge_variant;
+    function<void(Detector &, buffers &, pixel_grid)> setup;
+    function<void(Detector &, buffers &, pixel_grid)> run;
+};
+
+struct benchmark_result {
+    string kernel;
+    int width;
+    int height;
+    string filter;
+    int area;
+    int threads;
+    long long grain;
+    string prewitt_variant;
+    string edge_variant;
+    sample_stats stats;
+    scaling_point scaling;
+};
+
+// A thread count that adds less than this to the speedup is not worth having.
+static const double FLATTEN_GAIN = 0.05;
+
+// The sweep start_detector runs: 64 thresholds, 4 to 256.
+static vector<int> sweep_thresholds() {
+    vector<int> thresholds;
+    for(int t = 4; t <= 256; t += 4) thresholds.push_back(t);
+    return thresholds;
+}
+
+static vector<benchmark_case> all_cases() {
+    vector<benchmark_case> cases;
+    auto none = [](Detector &, buffers &, pixel_grid) {};
+    for(kernel_variant v : {KERNEL_SCALAR, KERNEL_SIMD, KERNEL_UNROLLED, KERNEL_SEPARABLE}) {
+        cases.push_back({string("prewitt-") + kernel_variant_name(v), "", true, false, true, false, [v](Detector &d, buffers &, pixel_grid) {
+            d.set_prewitt_variant(v);
+        }, [](Detector &d, buffers &b, pixel_grid grid) {
+            d.parallel_prewitt(b.input.data(), b.first.data(), grid);
+        }});
+    }
+    for(kernel_variant v : {KERNEL_SCALAR, KERNEL_SIMD, KERNEL_RUNNING, KERNEL_BITPLANE}) {
+        cases.push_back({string("edge-") + kernel_variant_name(v), "", false, true, false, true, [v](Detector &d, buffers &, pixel_grid) {
+            d.set_edge_variant(v);
+        }, [](Detector &d, buffers &b, pixel_grid grid) {
+            d.parallel_edge_detection(b.input.data(), b.second.data(), grid);
+        }});
+    }
+    cases.push_back({"fused", "", true, true, true, true, none, [](Detector &d, buffers &b, pixel_grid grid) {
+        d.fused_detection(b.input.data(), b.first.data(), b.second.data(), (vector<tile_stats> *)nullptr, grid);
+    }});
+    cases.push_back({"magnitude", "", true, false, false, false, none, [](Detector &d, buffers &b, pixel_grid grid) {
+        d.prewitt_magnitude(b.input.data(), b.magnitude.data(), grid);
+    }});
+    // thresholds a real gradient rather than the zeroed buffer
+    cases.push_back({"threshold", "", false, false, false, false, [](Detector &d, buffers &b, pixel_grid grid) {
+        d.prewitt_magnitude(b.input.data(), b.magnitude.data(), grid);
+    }, [](Detector &d, buffers &b, pixel_grid) {
+        d.threshold_magnitude(b.magnitude.data(), b.first.data(), THRESHOLD);
+    }});
+    // every threshold at once, to be read against one run of the same kernel
+    cases.push_back({"prewitt-sweep", "prewitt-simd", true, false, false, false, [](Detector &, buffers &b, pixel_grid) {
+        b.sweep = make_sweep(sweep_thresholds(), b.width, b.height);
+    }, [](Detector &d, buffers &b, pixel_grid grid) {
+        d.prewitt_sweep(b.input.data(), &b.sweep, grid);
+    }});
+    cases.push_back({"edge-sweep", "edge-simd", false, true, false, false, [](Detector &, buffers &b, pixel_grid) {
+        b.sweep = make_sweep(sweep_thresholds(), b.width, b.height);
+    }, [](Detector &d, buffers &b, pixel_grid grid) {
+        d.edge_sweep(b.input.data(), &b.sweep, grid);
+    }});
+    cases.push_back({"canny", "", false, false, false, false, none, [](Detector &d, buffers &b, pixel_grid) {
+        d.canny_detection(b.input.data(), b.first.data());
+    }});
+    return cases;
+}
+
+static vector<string> split(const string &list) {
+    vector<string> items;
+    stringstream stream(list);
+    string item;
+    while(getline(stream, item, ',')) if(!item.empty()) items.push_back(item);
+    return items;
+}
+
+static bool parse_ints(const string &list, vector<int> *values) {
+    values->clear();
+    for(const string &item : split(list)) {
+        char *end;
+        long value = strtol(item.c_str(), &end, 10);
+        if(*end != '\0' || value < 0) return false;
+        values->push_back(value);
+    }
+    return !values->empty();
+}
+
+static string json_escape(const string &text) {
+    string escaped;
+    for(char c : text) {
+        if(c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+static void write_json(const string &path, const string &label, const vector<benchmark_result> &results) {
+    ofstream file(path);
+    file << "{\n  \"machine\": \"" << json_escape(machine_id()) << "\",\n  \"label\": \"" << json_escape(label)
+         << "\",\n  \"isa\": \"" << simd_isa_name(simd_active_isa()) << "\",\n  \"results\": [";
+    for(size_t k = 0; k < results.size(); ++k) {
+        const benchmark_result &r = results[k];
+        double pixels = (double)r.width * r.height;
+        file << (k ? "," : "") << "\n    {\"kernel\": \"" << r.kernel << "\", \"width\": " << r.width << ", \"height\": " << r.height
+             << ", \"filter\": \"" << r.filter << "\", \"area\": " << r.area << ", \"threads\": " << r.threads << ", \"grain\": " << r.grain
+             << ", \"prewitt_variant\": \"" << r.prewitt_variant << "\", \"edge_variant\": \"" << r.edge_variant << "\""
+             << ", \"samples\": " << r.stats.samples << ", \"outliers\": " << r.stats.outliers
+             << ", \"min_ns\": " << r.stats.min << ", \"median_ns\": " << r.stats.median << ", \"p90_ns\": " << r.stats.p90
+             << ", \"p99_ns\": " << r.stats.p99 << ", \"mean_ns\": " << r.stats.mean << ", \"stddev_ns\": " << r.stats.stddev
+             << ", \"ns_per_pixel\": " << r.stats.median / pixels << ", \"mpixel_per_s\": " << pixels / r.stats.median * 1e3
+             << ", \"speedup\": " << r.scaling.speedup << ", \"efficiency\": " << r.scaling.efficiency
+             << ", \"serial_fraction\": " << r.scaling.serial_fraction << "}";
+    }
+    file << "\n  ]\n}\n";
+    if(!file) cout << "ERROR: cannot write " << path << "!" << endl;
+}
+
+static void write_csv(const string &path, const string &label, const vector<benchmark_result> &results) {
+    ofstream file(path);
+    file << "label,kernel,width,height,filter,area,threads,grain,prewitt_variant,edge_variant,samples,outliers,min_ns,median_ns,p90_ns,p99_ns,mean_ns,stddev_ns,ns_per_pixel,mpixel_per_s,speedup,efficiency,serial_fraction\n";
+    for(const benchmark_result &r : results) {
+        double pixels = (double)r.width * r.height;
+        file << label << "," << r.kernel << "," << r.width << "," << r.height << "," << r.filter << "," << r.area << "," << r.threads << ","
+             << r.grain << "," << r.prewitt_variant << "," << r.edge_variant << "," << r.stats.samples << "," << r.stats.outliers << "," << r.stats.min << "," << r.stats.median << ","
+             << r.stats.p90 << "," << r.stats.p99 << "," << r.stats.mean << "," << r.stats.stddev << ","
+             << r.stats.median / pixels << "," << pixels / r.stats.median * 1e3 << ","
+             << r.scaling.speedup << "," << r.scaling.efficiency << "," << r.scaling.serial_fraction << "\n";
+    }
+    if(!file) cout << "ERROR: cannot write " << path << "!" << endl;
+}
+
+// Fills in the scaling of results[first..] against their single-thread run,
+// which comes first, and prints it when asked to.
+static void report_scaling(vector<benchmark_result> &results, size_t first, bool print) {
+    vector<int> threads;
+    vector<double> medians;
+    for(size_t k = first; k < results.size(); ++k) {
+        threads.push_back(results[k].threads);
+        medians.push_back(results[k].stats.median);
+    }
+    vector<scaling_point> points = strong_scaling(threads, medians);
+    for(size_t k = 0; k < points.size(); ++k) results[first + k].scaling = points[k];
+    if(!print || points.size() < 2) return;
+    cout << "    threads   speedup  efficiency  serial fraction" << endl << fixed << setprecision(3);
+    for(const scaling_point &p : points) {
+        cout << "    " << setw(7) << p.threads << setw(10) << p.speedup << setw(12) << p.efficiency << setw(17) << p.serial_fraction << endl;
+    }
+    cout.unsetf(ios::fixed);
+    int knee = scaling_knee(points, FLATTEN_GAIN);
+    if(knee == points.back().threads) cout << "    Still scaling at " << knee << " threads." << endl;
+    else cout << "    Flattens at " << knee << (knee == 1 ? " thread" : " threads") << ": more add under " << FLATTEN_GAIN * 100 << "% speedup." << endl;
+}
+
+// Cases with a baseline against the run of that kernel on the same
+// size, filter, area and thread count.
+static void report_baselines(const vector<benchmark_case> &cases, const vector<benchmark_result> &results) {
+    for(const benchmark_result &r : results) {
+        string baseline;
+        for(const benchmark_case &c : cases) if(c.name == r.kernel) baseline = c.baseline;
+        if(baseline.empty()) continue;
+        for(const benchmark_result &b : results) {
+            if(b.kernel != baseline || b.width != r.width || b.height != r.height || b.threads != r.threads) continue;
+            if((r.filter != "-" && b.filter != r.filter) || (r.area != 0 && b.area != r.area)) continue;
+            cout << r.kernel << " " << r.width << "x" << r.height << " " << (r.filter != "-" ? r.filter : "area " + to_string(r.area))
+                 << ", " << r.threads << (r.threads == 1 ? " thread: " : " threads: ") << fixed << setprecision(2)
+                 << r.stats.median / b.stats.median << "x one " << baseline << " run" << endl;
+            cout.unsetf(ios::fixed);
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    vector<benchmark_case> cases = all_cases();
+    vector<string> kernels;
+    for(const benchmark_case &c : cases) kernels.push_back(c.name);
+    vector<pair<int, int>> sizes = {{640, 480}, {1920, 1080}};
+    vector<string> filters = {"prewitt3", "prewitt5"};
+    vector<int> areas = {1, 2};
+    vector<int> threads = {1};
+    if(thread::hardware_concurrency() > 1) threads.push_back(thread::hardware_concurrency());
+    int warmup = 3, repetitions = 20, scaling = -1;
+    string label, json_path, csv_path;
+
+    for(int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if(i + 1 >= argc) {
+            cout << "ERROR: " << option << " needs a value!" << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        bool ok = true;
+        if(option == "--kernels") kernels = split(value);
+        else if(option == "--filters") filters = split(value);
+        else if(option == "--areas") ok = parse_ints(value, &areas);
+        else if(option == "--threads") ok = parse_ints(value, &threads);
+        else if(option == "--scaling") ok = sscanf(value.c_str(), "%d", &scaling) == 1 && scaling >= 0;
+        else if(option == "--warmup") ok = sscanf(value.c_str(), "%d", &warmup) == 1 && warmup >= 0;
+        else if(option == "--reps") ok = sscanf(value.c_str(), "%d", &repetitions) == 1 && repetitions > 0;
+        else if(option == "--label") label = value;
+        else if(option == "--json") json_path = value;
+        else if(option == "--csv") csv_path = value;
+        else if(option == "--sizes") {
+            sizes.clear();
+            for(const string &size : split(value)) {
+                int width, height;
+                ok = ok && sscanf(size.c_str(), "%dx%d", &width, &height) == 2 && width >= 16 && height >= 16;
+                sizes.push_back({width, height});
+            }
+        }
+        else {
+            cout << "ERROR: unknown option " << option << "!" << endl;
+            return 1;
+        }
+        if(!ok) {
+            cout << "ERROR: bad value " << value << " for " << option << "!" << endl;
+            return 1;
+        }
+    }
+    for(const string &name : filters) {
+        if(find_filter(name) == nullptr) {
+            cout << "ERROR: unknown filter " << name << "!" << endl;
+            return 1;
+        }
+    }
+    if(scaling >= 0) {
+        threads.clear();
+        for(int t = 1; t <= (scaling > 0 ? scaling : (int)thread::hardware_concurrency()); ++t) threads.push_back(t);
+    }
+    for(int t : threads) {
+        if(t < 1) {
+            cout << "ERROR: thread counts must be at least 1!" << endl;
+            return 1;
+        }
+    }
+
+    cout << "Machine: " << machine_id() << " | ISA: " << simd_isa_name(simd_active_isa()) << endl;
+    cout << left << setw(18) << "kernel" << setw(11) << "size" << setw(10) << "filter" << setw(6) << "area" << setw(8) << "threads"
+         << setw(18) << "prewitt/edge"
+         << right << setw(12) << "median ms" << setw(10) << "p90 ms" << setw(10) << "p99 ms" << setw(10) << "sd ms"
+         << setw(9) << "ns/px" << setw(10) << "Mpx/s" << setw(5) << "out" << endl;
+
+    vector<benchmark_result> results;
+    for(const pair<int, int> &size : sizes) {
+        int width = size.first, height = size.second;
+        size_t pixels = (size_t)width * height;
+        buffers b = {width, height, synthetic_image(width, height), vector<pixel>(pixels), vector<pixel>(pixels), vector<gradient>(pixels), {}};
+        for(const string &kernel : kernels) {
+            const benchmark_case *c = nullptr;
+            for(const benchmark_case &candidate : cases) if(candidate.name == kernel) c = &candidate;
+            if(c == nullptr) {
+                cout << "ERROR: unknown kernel " << kernel << "!" << endl;
+                return 1;
+            }
+            for(size_t f = 0; f < (c->uses_filter ? filters.size() : 1); ++f) {
+                for(size_t a = 0; a < (c->uses_area ? areas.size() : 1); ++a) {
+                    int offset = max((find_filter(filters[f])->size - 1) / 2, areas[a]);
+                    pixel_grid grid = {offset, width - offset, offset, height - offset};
+                    if(width <= 2 * offset || height <= 2 * offset) continue;
+                    Detector d;
+                    d.set_border(BORDER_NONE, 0);
+                    d.set_image_width(width);
+                    d.set_image_height(height);
+                    d.set_filter(filters[f]);
+                    d.set_area(areas[a]);
+                    d.apply_tuning();
+                    c->setup(d, b, grid);
+                    string prewitt_variant = c->uses_prewitt_variant ? kernel_variant_name(d.get_prewitt_variant()) : "-";
+                    string edge_variant = c->uses_edge_variant ? kernel_variant_name(d.get_edge_variant()) : "-";
+                    size_t first = results.size();
+                    for(int t : threads) {
+                        tbb::global_control limit(tbb::global_control::max_allowed_parallelism, t);
+                        tbb::task_arena arena(t);
+                        vector<double> samples;
+                        arena.execute([&] {
+                            for(int w = 0; w < warmup; ++w) c->run(d, b, grid);
+                            for(int r = 0; r < repetitions; ++r) {
+                                auto start = chrono::steady_clock::now();
+                                c->run(d, b, grid);
+                                samples.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+                            }
+                        });
+                        benchmark_result result = {c->name, width, height, c->uses_filter ? filters[f] : "-", c->uses_area ? 2 * areas[a] + 1 : 0,
+                                                   t, d.get_grain(), prewitt_variant, edge_variant, summarize(samples), {t, 0, 0, 0}};
+                        results.push_back(result);
+                        ostringstream dims;
+                        dims << width << "x" << height;
+                        cout << left << setw(18) << result.kernel << setw(11) << dims.str() << setw(10) << result.filter << setw(6) << result.area
+                             << setw(8) << t << setw(18) << prewitt_variant + "/" + edge_variant << right << fixed << setprecision(3) << setw(12) << result.stats.median / 1e6
+                             << setw(10) << result.stats.p90 / 1e6 << setw(10) << result.stats.p99 / 1e6 << setw(10) << result.stats.stddev / 1e6
+                             << setw(9) << result.stats.median / pixels << setprecision(1) << setw(10) << pixels / result.stats.median * 1e3
+                             << setw(5) << result.stats.outliers << endl;
+                        cout.unsetf(ios::fixed);
+                    }
+                    if(threads[0] == 1) report_scaling(results, first, scaling >= 0);
+                }
+            }
+        }
+    }
+    report_baselines(cases, results);
+    if(!json_path.empty()) write_json(json_path, label, results);
+    if(!csv_path.empty()) write_csv(csv_path, label, results);
+    return trace_dump() ? 0 : 1;
+}
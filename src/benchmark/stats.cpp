@@ -0,0 +1,67 @@
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+static const double OUTLIER_MADS = 3.0;
+// MAD of a normal distribution is 0.6745 sigma
+static const double MAD_TO_SIGMA = 1.4826;
+
+// Nearest rank on sorted samples.
+double percentile(const vector<double> &sorted, double p) {
+    if(sorted.empty()) return 0;
+    size_t rank = (size_t)ceil(p / 100 * sorted.size());
+    return sorted[min(max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+sample_stats summarize(vector<double> samples) {
+    sample_stats s = {(int)samples.size(), 0, 0, 0, 0, 0, 0, 0};
+    if(samples.empty()) return s;
+    sort(samples.begin(), samples.end());
+    s.median = percentile(samples, 50);
+
+    vector<double> deviations;
+    for(double v : samples) deviations.push_back(fabs(v - s.median));
+    sort(deviations.begin(), deviations.end());
+    double limit = OUTLIER_MADS * MAD_TO_SIGMA * percentile(deviations, 50);
+    if(limit > 0) {
+        vector<double> kept;
+        for(double v : samples) if(fabs(v - s.median) <= limit) kept.push_back(v);
+        s.outliers = samples.size() - kept.size();
+        samples.swap(kept);
+    }
+
+    s.min = samples.front();
+    s.p90 = percentile(samples, 90);
+    s.p99 = percentile(samples, 99);
+    double sum = 0, squares = 0;
+    for(double v : samples) sum += v;
+    s.mean = sum / samples.size();
+    for(double v : samples) squares += (v - s.mean) * (v - s.mean);
+    s.stddev = samples.size() > 1 ? sqrt(squares / (samples.size() - 1)) : 0;
+    return s;
+}
+
+// medians[k] is the time with threads[k] threads; threads[0] must be 1.
+vector<scaling_point> strong_scaling(const vector<int> &threads, const vector<double> &medians) {
+    vector<scaling_point> points;
+    for(size_t k = 0; k < threads.size(); ++k) {
+        double speedup = medians[0] / medians[k];
+        int n = threads[k];
+        double serial = n > 1 ? (1 / speedup - 1.0 / n) / (1 - 1.0 / n) : 0;
+        points.push_back({n, speedup, speedup / n, serial});
+    }
+    return points;
+}
+
+// The thread count after which no later point improves the speedup by more
+// than gain (0.05 = 5%) over it; the last count when it is still scaling.
+int scaling_knee(const vector<scaling_point> &points, double gain) {
+    for(size_t k = 0; k < points.size(); ++k) {
+        bool flat = true;
+        for(size_t later = k + 1; later < points.size(); ++later) flat = flat && points[later].speedup < points[k].speedup * (1 + gain);
+        if(flat) return points[k].threads;
+    }
+    return points.empty() ? 0 : points.back().threads;
+}
@@ -0,0 +1,32 @@
+#include <vector>
+
+#pragma once
+
+// Summary of repeated timings. Samples further than OUTLIER_MADS scaled
+// median absolute deviations from the median are dropped before anything but
+// the median is computed; outliers counts them.
+struct sample_stats {
+    int samples;
+    int outliers;
+    double min;
+    double median;
+    double p90;
+    double p99;
+    double mean;
+    double stddev;
+};
+
+double percentile(const std::vector<double> &, double);
+sample_stats summarize(std::vector<double>);
+
+// Strong scaling against the single-thread time: speedup S = T1 / Tn,
+// efficiency S / n and the Karp-Flatt serial fraction (1/S - 1/n) / (1 - 1/n).
+struct scaling_point {
+    int threads;
+    double speedup;
+    double efficiency;
+    double serial_fraction;
+};
+
+std::vector<scaling_point> strong_scaling(const std::vector<int> &, const std::vector<double> &);
+int scaling_knee(const std::vector<scaling_point> &, double);
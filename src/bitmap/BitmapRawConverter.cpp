@@ -7,9 +7,19 @@
 
 
 #include "BitmapRawConverter.h"
+#include "MappedBitmapReader.h"
+#include "GrayConversion.h"
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <stdlib.h>
+#include <string.h>
+#include "../trace/trace.h"
+#include "../trace/counters.h"
 
-BitmapRawConverter::BitmapRawConverter(char *filename) {
+BitmapRawConverter::BitmapRawConverter(char *filename) : bitDepth(24) {
+	if (readMappedGray(filename, &pixels, &width, &height)) {
+		return;
+	}
 	bitmap.ReadFromFile(filename);
 	width = bitmap.TellWidth();
 	height = bitmap.TellHeight();
@@ -17,27 +27,55 @@ BitmapRawConverter::BitmapRawConverter(char *filename) {
 	bitmapToPixels();
 }
 
+// Output only: a blank width x height buffer, no file is read.
+BitmapRawConverter::BitmapRawConverter(int width, int height) : width(width), height(height), bitDepth(24) {
+	pixels = (uint8_t *) calloc(width * height, sizeof(uint8_t));
+}
+
+// BMP rows and the gray buffer are both row-major, so each row converts in
+// one contiguous pass; rows are spread over the TBB workers.
 void BitmapRawConverter::bitmapToPixels() {
-	pixels = (int *) malloc(width * height * sizeof(int));  //new int[width * height];
+	trace_span span("bitmapToPixels");
+	counter_region counters("bitmapToPixels");
+	pixels = (uint8_t *) malloc(width * height * sizeof(uint8_t));
 
-	for (int i = 0; i < width; i++) {
-		for (int j = 0; j < height; j++) {
-			RGBApixel pxl = bitmap.GetPixel(i,j);
-			putPixel(i, j, pxl);
+	tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int> &r) {
+		for (int j = r.begin(); j < r.end(); j++) {
+			bgrToGray((const uint8_t *) bitmap.RowPointer(j), pixels + j * width, width, sizeof(RGBApixel));
 		}
+	});
+}
+
+// Against the gray ramp an 8-bit index is the gray value itself and a 1-bit
+// one is gray >= 128, so rows are copied or bit-packed, no palette search.
+void BitmapRawConverter::encodeGrayRow(int row, ebmpBYTE *buffer, void *context) {
+	const BitmapRawConverter *converter = (const BitmapRawConverter *) context;
+	const uint8_t *gray = converter->pixels + row * converter->width;
+	if (converter->bitDepth == 8) {
+		memcpy(buffer, gray, converter->width);
+	} else {
+		grayToBits(gray, buffer, converter->width);
 	}
 }
 
 void BitmapRawConverter::pixelsToBitmap(char *outFilename) {
+	trace_span span("pixelsToBitmap");
+	counter_region counters("pixelsToBitmap");
 	BMP out;
+	out.SetBitDepth(bitDepth);
+	// paletted files never get an RGBA pixel block
+	if (bitDepth != 24) {
+		CreateGrayscaleColorTable(out);
+		out.WriteEncodedToFile(outFilename, width, height, encodeGrayRow, this);
+		return;
+	}
 	out.SetSize(width, height);
-	out.SetBitDepth(24);
 
-	for (int i = 0; i < width; i++) {
-		for (int j = 0; j < height; j++) {
-			out.SetPixel(i, j, getPixel(i,j));
+	tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int> &r) {
+		for (int j = r.begin(); j < r.end(); j++) {
+			grayToBgra(pixels + j * width, (uint8_t *) out.RowPointer(j), width);
 		}
-	}
+	});
 	out.WriteToFile(outFilename);
 }
 
@@ -55,14 +93,39 @@ void BitmapRawConverter::putPixel(int i, int j, RGBApixel value) {
 	pixels[j * width + i] = ((30 * value.Red) + (59 * value.Green) + (11 * value.Blue)) / 100;
 }
 
-int *BitmapRawConverter::getBuffer()
+uint8_t *BitmapRawConverter::getBuffer()
 {
 	return pixels;
 }
 
-void BitmapRawConverter::setBuffer(int *buffer)
+const uint8_t *BitmapRawConverter::getBuffer() const
 {
-	memcpy((void *)pixels, (void *)buffer, width * height * sizeof(int));
+	return pixels;
+}
+
+void BitmapRawConverter::setBuffer(const uint8_t *buffer)
+{
+	trace_span span("setBuffer");
+	counter_region counters("setBuffer");
+	memcpy((void *)pixels, (const void *)buffer, width * height * sizeof(uint8_t));
+}
+
+void BitmapRawConverter::setBuffer(const int *buffer)
+{
+	trace_span span("setBuffer");
+	counter_region counters("setBuffer");
+	for (int k = 0; k < width * height; k++) {
+		pixels[k] = buffer[k];
+	}
+}
+
+void BitmapRawConverter::copyBuffer(int *buffer) const
+{
+	trace_span span("copyBuffer");
+	counter_region counters("copyBuffer");
+	for (int k = 0; k < width * height; k++) {
+		buffer[k] = pixels[k];
+	}
 }
 
 int BitmapRawConverter::getHeight() const
@@ -85,7 +148,24 @@ void BitmapRawConverter::setWidth(int width)
     this->width = width;
 }
 
+int BitmapRawConverter::getBitDepth() const
+{
+    return bitDepth;
+}
+
+// 24 writes R = G = B; 8 writes a gray palette; 1 keeps only black and white,
+// which loses nothing for the 0/255 edge masks.
+bool BitmapRawConverter::setBitDepth(int bitDepth)
+{
+    if (bitDepth != 1 && bitDepth != 8 && bitDepth != 24) {
+        std::cout << "ERROR: output bit depth must be 1, 8 or 24!" << std::endl;
+        return false;
+    }
+    this->bitDepth = bitDepth;
+    return true;
+}
+
 BitmapRawConverter::~BitmapRawConverter() {
-	delete pixels;
+	free(pixels);
 }
 
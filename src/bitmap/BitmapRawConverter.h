@@ -8,6 +8,7 @@
 #ifndef BITMAPRAWCONVERTER_H_
 #define BITMAPRAWCONVERTER_H_
 
+#include <cstdint>
 #include "EasyBMP.h"
 
 class BitmapRawConverter {
@@ -15,7 +16,10 @@ private:
 	BMP bitmap;
 	int width;
 	int height;
-	int *pixels;
+	int bitDepth;
+	uint8_t *pixels;
+
+	static void encodeGrayRow(int row, ebmpBYTE *buffer, void *context);
 public:
 	void bitmapToPixels();
 	void pixelsToBitmap(char *outFilename);
@@ -23,17 +27,23 @@ public:
 	RGBApixel getPixel(int i, int j);
 	void putPixel(int i, int j, RGBApixel value);
 
-	int *getBuffer();
-	void setBuffer(int *buffer);
+	uint8_t *getBuffer();
+	const uint8_t *getBuffer() const;
+	void setBuffer(const uint8_t *buffer);
+	void setBuffer(const int *buffer);
+	void copyBuffer(int *buffer) const;
 
 
 
 	BitmapRawConverter(char *filename);
+	BitmapRawConverter(int width, int height);
 	virtual ~BitmapRawConverter();
     int getHeight() const;
     int getWidth() const;
     void setHeight(int height);
     void setWidth(int width);
+    int getBitDepth() const;
+    bool setBitDepth(int bitDepth);
 };
 
 #endif /* BITMAPRAWCONVERTER_H_ */
@@ -19,6 +19,8 @@
 *************************************************/
 
 #include "EasyBMP.h"
+#include "../trace/trace.h"
+#include "../trace/counters.h"
 
 /* These functions are defined in EasyBMP.h */
 
@@ -131,12 +133,12 @@ RGBApixel BMP::GetPixel( int i, int j ) const
        << "                 Truncating request to fit in the range [0,"
        << Width-1 << "] x [0," << Height-1 << "]." << endl;
  }	
- return Pixels[i][j];
+ return At(i,j);
 }
 
 bool BMP::SetPixel( int i, int j, RGBApixel NewPixel )
 {
- Pixels[i][j] = NewPixel;
+ At(i,j) = NewPixel;
  return true;
 }
 
@@ -220,14 +222,23 @@ RGBApixel BMP::GetColor( int ColorNumber )
  return Output;
 }
 
+// Frees the old block; the new one is left uninitialized.
+void BMP::AllocatePixels( int NewWidth, int NewHeight )
+{
+ free( Pixels );
+ Width = NewWidth;
+ Height = NewHeight;
+ size_t Bytes = (size_t) Width*Height*sizeof(RGBApixel);
+ Pixels = (RGBApixel*) aligned_alloc( 64, (Bytes+63)/64*64 );
+}
+
 BMP::BMP()
 {
- Width = 1;
- Height = 1;
+ Pixels = NULL;
+ AllocatePixels(1,1);
  BitDepth = 24;
- Pixels = new RGBApixel* [Width];
- Pixels[0] = new RGBApixel [Height];
  Colors = NULL;
+ GrayscaleTable = false;
  
  XPelsPerMeter = 0;
  YPelsPerMeter = 0;
@@ -241,14 +252,11 @@ BMP::BMP()
 // BMP::BMP( const BMP& Input )
 BMP::BMP( BMP& Input )
 {
- // first, make the image empty.
-
- Width = 1;
- Height = 1;
+ Pixels = NULL;
+ AllocatePixels( Input.TellWidth() , Input.TellHeight() );
  BitDepth = 24;
- Pixels = new RGBApixel* [Width];
- Pixels[0] = new RGBApixel [Height];
  Colors = NULL; 
+ GrayscaleTable = false;
  XPelsPerMeter = 0;
  YPelsPerMeter = 0;
  
@@ -261,43 +269,23 @@ BMP::BMP( BMP& Input )
  
  SetBitDepth( Input.TellBitDepth() );
  
- // set the correct pixel size 
- 
- SetSize( Input.TellWidth() , Input.TellHeight() );
-
  // set the DPI information from Input
  
  SetDPI( Input.TellHorizontalDPI() , Input.TellVerticalDPI() );
  
  // if there is a color table, get all the colors
 
- if( BitDepth == 1 || BitDepth == 4 ||  
-     BitDepth == 8 )
- {
-  for( int k=0 ; k < TellNumberOfColors() ; k++ )
-  {
-   SetColor( k, Input.GetColor( k )); 
-  }
- }
+ if( Colors )
+ { memcpy( Colors, Input.Colors, TellNumberOfColors()*sizeof(RGBApixel) ); }
  
- // get all the pixels 
+ // get all the pixels in one copy
  
- for( int j=0; j < Height ; j++ )
- {
-  for( int i=0; i < Width ; i++ )
-  {
-   Pixels[i][j] = *Input(i,j);
-//   Pixels[i][j] = Input.GetPixel(i,j); // *Input(i,j);
-  }
- }
+ memcpy( Pixels, Input.Pixels, (size_t) Width*Height*sizeof(RGBApixel) );
 }
 
 BMP::~BMP()
 {
- int i;
- for(i=0;i<Width;i++)
- { delete [] Pixels[i]; }
- delete [] Pixels;
+ free( Pixels );
  if( Colors )
  { delete [] Colors; }
  
@@ -325,7 +313,7 @@ RGBApixel* BMP::operator()(int i, int j)
        << "                 Truncating request to fit in the range [0,"
        << Width-1 << "] x [0," << Height-1 << "]." << endl;
  }	
- return &(Pixels[i][j]);
+ return &At(i,j);
 }
 
 // int BMP::TellBitDepth( void ) const
@@ -394,36 +382,29 @@ bool BMP::SetSize(int NewWidth , int NewHeight )
   return false;
  }
 
- int i,j; 
+ if( NewWidth != Width || NewHeight != Height )
+ { AllocatePixels( NewWidth, NewHeight ); }
 
- for(i=0;i<Width;i++)
- { delete [] Pixels[i]; }
- delete [] Pixels;
-
- Width = NewWidth;
- Height = NewHeight;
- Pixels = new RGBApixel* [ Width ]; 
- 
- for(i=0; i<Width; i++)
- { Pixels[i] = new RGBApixel [ Height ]; }
- 
- for( i=0 ; i < Width ; i++)
- {
-  for( j=0 ; j < Height ; j++ )
-  {
-   Pixels[i][j].Red = 255; 
-   Pixels[i][j].Green = 255; 
-   Pixels[i][j].Blue = 255; 
-   Pixels[i][j].Alpha = 0;    
-  }
- }
+ RGBApixel WHITE;
+ WHITE.Red = 255;
+ WHITE.Green = 255;
+ WHITE.Blue = 255;
+ WHITE.Alpha = 0;
+ std::span<RGBApixel> All = PixelSpan();
+ std::fill( All.begin(), All.end(), WHITE );
 
  return true; 
 }
 
 bool BMP::WriteToFile( const char* FileName )
+{ return WriteFile( FileName, Width, Height, NULL, NULL ); }
+
+bool BMP::WriteFile( const char* FileName, int FileWidth, int FileHeight,
+                     EasyBMProwEncoder Encode, void* Context )
 {
  using namespace std;
+ trace_span span("EasyBMP::WriteToFile");
+ counter_region counters("EasyBMP::WriteToFile");
  if( !EasyBMPcheckDataSize() )
  {
   if( EasyBMPwarnings )
@@ -452,7 +433,7 @@ bool BMP::WriteToFile( const char* FileName )
  // some preliminaries
  
  double dBytesPerPixel = ( (double) BitDepth ) / 8.0;
- double dBytesPerRow = dBytesPerPixel * (Width+0.0);
+ double dBytesPerRow = dBytesPerPixel * (FileWidth+0.0);
  dBytesPerRow = ceil(dBytesPerRow);
   
  int BytePaddingPerRow = 4 - ( (int) (dBytesPerRow) )% 4;
@@ -461,7 +442,7 @@ bool BMP::WriteToFile( const char* FileName )
  
  double dActualBytesPerRow = dBytesPerRow + BytePaddingPerRow;
  
- double dTotalPixelBytes = Height * dActualBytesPerRow;
+ double dTotalPixelBytes = FileHeight * dActualBytesPerRow;
  
  double dPaletteSize = 0;
  if( BitDepth == 1 || BitDepth == 4 || BitDepth == 8 )
@@ -494,8 +475,8 @@ bool BMP::WriteToFile( const char* FileName )
  
  BMIH bmih;
  bmih.biSize = 40;
- bmih.biWidth = Width;
- bmih.biHeight = Height;
+ bmih.biWidth = FileWidth;
+ bmih.biHeight = FileHeight;
  bmih.biPlanes = 1;
  bmih.biBitCount = BitDepth;
  bmih.biCompression = 0;
@@ -554,30 +535,36 @@ bool BMP::WriteToFile( const char* FileName )
  if( BitDepth != 16 )
  {  
   ebmpBYTE* Buffer;
-  int BufferSize = (int) ( (Width*BitDepth)/8.0 );
-  while( 8*BufferSize < Width*BitDepth )
+  int BufferSize = (int) ( (FileWidth*BitDepth)/8.0 );
+  while( 8*BufferSize < FileWidth*BitDepth )
   { BufferSize++; }
   while( BufferSize % 4 )
   { BufferSize++; }
   
   Buffer = new ebmpBYTE [BufferSize];
+  GrayscaleTable = HasGrayscaleColorTable();
   for( j=0 ; j < BufferSize; j++ )
   { Buffer[j] = 0; }
     
-  j=Height-1;
+  j=FileHeight-1;
   
   while( j > -1 )
   {
    bool Success = false;
-   if( BitDepth == 32 )
+   if( Encode )
+   {
+    Encode( j, Buffer, Context );
+    Success = true;
+   }
+   else if( BitDepth == 32 )
    { Success = Write32bitRow( Buffer, BufferSize, j ); }
-   if( BitDepth == 24 )
+   else if( BitDepth == 24 )
    { Success = Write24bitRow( Buffer, BufferSize, j ); }
-   if( BitDepth == 8  )
+   else if( BitDepth == 8  )
    { Success = Write8bitRow( Buffer, BufferSize, j ); }
-   if( BitDepth == 4  )
+   else if( BitDepth == 4  )
    { Success = Write4bitRow( Buffer, BufferSize, j ); }
-   if( BitDepth == 1  )
+   else if( BitDepth == 1  )
    { Success = Write1bitRow( Buffer, BufferSize, j ); }
    if( Success )
    {
@@ -606,7 +593,7 @@ bool BMP::WriteToFile( const char* FileName )
   ebmpWORD BlueMask = 31;    // bits 12-16
   ebmpWORD GreenMask = 2016; // bits 6-11
   ebmpWORD RedMask = 63488;  // bits 1-5
-  ebmpWORD ZeroWORD;
+  ebmpWORD ZeroWORD = 0;
   
   if( IsBigEndian() )
   { RedMask = FlipWORD( RedMask ); }
@@ -637,9 +624,9 @@ bool BMP::WriteToFile( const char* FileName )
    {
     ebmpWORD TempWORD;
 	
-	ebmpWORD RedWORD = (ebmpWORD) ((Pixels[i][j]).Red / 8);
-	ebmpWORD GreenWORD = (ebmpWORD) ((Pixels[i][j]).Green / 4);
-	ebmpWORD BlueWORD = (ebmpWORD) ((Pixels[i][j]).Blue / 8);
+	ebmpWORD RedWORD = (ebmpWORD) (At(i,j).Red / 8);
+	ebmpWORD GreenWORD = (ebmpWORD) (At(i,j).Green / 4);
+	ebmpWORD BlueWORD = (ebmpWORD) (At(i,j).Blue / 8);
 	
     TempWORD = (RedWORD<<11) + (GreenWORD<<5) + BlueWORD;
 	if( IsBigEndian() )
@@ -665,9 +652,27 @@ bool BMP::WriteToFile( const char* FileName )
  return true;
 }
 
+bool BMP::WriteEncodedToFile( const char* FileName, int FileWidth, int FileHeight,
+                              EasyBMProwEncoder Encode, void* Context )
+{
+ using namespace std;
+ if( FileWidth <= 0 || FileHeight <= 0 || BitDepth == 16 || !Encode )
+ {
+  if( EasyBMPwarnings )
+  {
+   cout << "EasyBMP Error: Encoded output needs a positive size, a row" << endl
+        << "               encoder and a bit depth other than 16." << endl;
+  }
+  return false;
+ }
+ return WriteFile( FileName, FileWidth, FileHeight, Encode, Context );
+}
+
 bool BMP::ReadFromFile( const char* FileName )
 { 
  using namespace std;
+ trace_span span("EasyBMP::ReadFromFile");
+ counter_region counters("EasyBMP::ReadFromFile");
  if( !EasyBMPcheckDataSize() )
  {
   if( EasyBMPwarnings )
@@ -1062,9 +1067,9 @@ bool BMP::ReadFromFile( const char* FileName )
     ebmpBYTE GreenBYTE = (ebmpBYTE) 8*(Green>>GreenShift);
     ebmpBYTE RedBYTE = (ebmpBYTE) 8*(Red>>RedShift);
 		
-	(Pixels[i][j]).Red = RedBYTE;
-	(Pixels[i][j]).Green = GreenBYTE;
-	(Pixels[i][j]).Blue = BlueBYTE;
+	At(i,j).Red = RedBYTE;
+	At(i,j).Green = GreenBYTE;
+	At(i,j).Blue = BlueBYTE;
 	
 	i++;
    }
@@ -1563,8 +1568,7 @@ bool BMP::Read32bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
  int i;
  if( Width*4 > BufferSize )
  { return false; }
- for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) &(Pixels[i][Row]), (char*) Buffer+4*i, 4 ); }
+ memcpy( (char*) RowPointer(Row), (char*) Buffer, 4*Width );
  return true;
 }
 
@@ -1573,8 +1577,13 @@ bool BMP::Read24bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
  int i;
  if( Width*3 > BufferSize )
  { return false; }
+ RGBApixel* Line = RowPointer(Row);
  for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) &(Pixels[i][Row]), Buffer+3*i, 3 ); }
+ {
+  Line[i].Blue = Buffer[3*i];
+  Line[i].Green = Buffer[3*i+1];
+  Line[i].Red = Buffer[3*i+2];
+ }
  return true;
 }
 
@@ -1586,7 +1595,7 @@ bool BMP::Read8bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
  for( i=0 ; i < Width ; i++ )
  {
   int Index = Buffer[i];
-  *( this->operator()(i,Row) )= GetColor(Index); 
+  At(i,Row) = GetColor(Index); 
  }
  return true;
 }
@@ -1607,7 +1616,7 @@ bool BMP::Read4bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
   while( j < 2 && i < Width )
   {
    int Index = (int) ( (Buffer[k]&Masks[j]) >> Shifts[j]);
-   *( this->operator()(i,Row) )= GetColor(Index); 
+   At(i,Row) = GetColor(Index); 
    i++; j++;   
   }
   k++;
@@ -1631,7 +1640,7 @@ bool BMP::Read1bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
   while( j < 8 && i < Width )
   {
    int Index = (int) ( (Buffer[k]&Masks[j]) >> Shifts[j]);
-   *( this->operator()(i,Row) )= GetColor(Index); 
+   At(i,Row) = GetColor(Index); 
    i++; j++;   
   }
   k++;
@@ -1644,8 +1653,7 @@ bool BMP::Write32bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
  int i;
  if( Width*4 > BufferSize )
  { return false; }
- for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) Buffer+4*i, (char*) &(Pixels[i][Row]), 4 ); }
+ memcpy( (char*) Buffer, (char*) RowPointer(Row), 4*Width );
  return true;
 }
 
@@ -1654,8 +1662,13 @@ bool BMP::Write24bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
  int i;
  if( Width*3 > BufferSize )
  { return false; }
+ const RGBApixel* Line = RowPointer(Row);
  for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) Buffer+3*i,  (char*) &(Pixels[i][Row]), 3 ); }
+ {
+  Buffer[3*i] = Line[i].Blue;
+  Buffer[3*i+1] = Line[i].Green;
+  Buffer[3*i+2] = Line[i].Red;
+ }
  return true;
 }
 
@@ -1665,7 +1678,7 @@ bool BMP::Write8bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
  if( Width > BufferSize )
  { return false; }
  for( i=0 ; i < Width ; i++ )
- { Buffer[i] = FindClosestColor( Pixels[i][Row] ); }
+ { Buffer[i] = ClosestColorIndex( At(i,Row) ); }
  return true;
 }
 
@@ -1684,7 +1697,7 @@ bool BMP::Write4bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
   int Index = 0;
   while( j < 2 && i < Width )
   {
-   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[i][Row] ) ); 
+   Index += ( PositionWeights[j]* (int) ClosestColorIndex( At(i,Row) ) ); 
    i++; j++;   
   }
   Buffer[k] = (ebmpBYTE) Index;
@@ -1708,7 +1721,7 @@ bool BMP::Write1bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
   int Index = 0;
   while( j < 8 && i < Width )
   {
-   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[i][Row] ) ); 
+   Index += ( PositionWeights[j]* (int) ClosestColorIndex( At(i,Row) ) ); 
    i++; j++;   
   }
   Buffer[k] = (ebmpBYTE) Index;
@@ -1717,6 +1730,35 @@ bool BMP::Write1bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
  return true;
 }
 
+// True when the color table is the gray ramp CreateGrayscaleColorTable makes
+// (entry k is k*255/(N-1) in every channel; the standard 1-bit table is one).
+bool BMP::HasGrayscaleColorTable( void )
+{
+ if( !Colors || ( BitDepth != 1 && BitDepth != 4 && BitDepth != 8 ) )
+ { return false; }
+ int NumberOfColors = TellNumberOfColors();
+ int StepSize = 255/(NumberOfColors-1);
+ for( int k=0 ; k < NumberOfColors ; k++ )
+ {
+  if( Colors[k].Red != k*StepSize || Colors[k].Green != k*StepSize || Colors[k].Blue != k*StepSize )
+  { return false; }
+ }
+ return true;
+}
+
+// Against a gray ramp the closest entry to a gray pixel is its value scaled
+// to the table and rounded (no ties are possible for 2, 16 or 256 entries),
+// which is what FindClosestColor would find without the search.
+ebmpBYTE BMP::ClosestColorIndex( RGBApixel& input )
+{
+ if( GrayscaleTable && input.Red == input.Green && input.Red == input.Blue )
+ {
+  int Top = (1 << BitDepth)-1;
+  return (ebmpBYTE) ( ( 2*input.Red*Top + 255 ) / 510 );
+ }
+ return FindClosestColor( input );
+}
+
 ebmpBYTE BMP::FindClosestColor( RGBApixel& input )
 {
  using namespace std;
@@ -1842,6 +1884,9 @@ bool Rescale( BMP& InputImage , char mode, int NewDimension )
  int I,J;
  double ThetaI,ThetaJ;
  
+ // the old image is read through row pointers; J+1 and I+1 are clamped the
+ // way the checked accessor would clamp them
+ 
  for( int j=0; j < NewHeight-1 ; j++ )
  {
   ThetaJ = (double)(j*(OldHeight-1.0))
@@ -1849,55 +1894,62 @@ bool Rescale( BMP& InputImage , char mode, int NewDimension )
   J	= (int) floor( ThetaJ );
   ThetaJ -= J;  
   
+  const RGBApixel* Old0 = OldImage.RowPointer( J );
+  const RGBApixel* Old1 = OldImage.RowPointer( J+1 < OldHeight ? J+1 : OldHeight-1 );
+  RGBApixel* New = InputImage.RowPointer( j );
+  
   for( int i=0; i < NewWidth-1 ; i++ )
   {
    ThetaI = (double)(i*(OldWidth-1.0))
            /(double)(NewWidth-1.0);
    I = (int) floor( ThetaI );
    ThetaI -= I;  
+   int I1 = I+1 < OldWidth ? I+1 : OldWidth-1;
    
-   InputImage(i,j)->Red = (ebmpBYTE) 
-                          ( (1.0-ThetaI-ThetaJ+ThetaI*ThetaJ)*(OldImage(I,J)->Red)
-                           +(ThetaI-ThetaI*ThetaJ)*(OldImage(I+1,J)->Red)   
-                           +(ThetaJ-ThetaI*ThetaJ)*(OldImage(I,J+1)->Red)   
-                           +(ThetaI*ThetaJ)*(OldImage(I+1,J+1)->Red) );
-   InputImage(i,j)->Green = (ebmpBYTE) 
-                          ( (1.0-ThetaI-ThetaJ+ThetaI*ThetaJ)*OldImage(I,J)->Green
-                           +(ThetaI-ThetaI*ThetaJ)*OldImage(I+1,J)->Green   
-                           +(ThetaJ-ThetaI*ThetaJ)*OldImage(I,J+1)->Green   
-                           +(ThetaI*ThetaJ)*OldImage(I+1,J+1)->Green );  
-   InputImage(i,j)->Blue = (ebmpBYTE) 
-                          ( (1.0-ThetaI-ThetaJ+ThetaI*ThetaJ)*OldImage(I,J)->Blue
-                           +(ThetaI-ThetaI*ThetaJ)*OldImage(I+1,J)->Blue   
-                           +(ThetaJ-ThetaI*ThetaJ)*OldImage(I,J+1)->Blue   
-                           +(ThetaI*ThetaJ)*OldImage(I+1,J+1)->Blue ); 
+   New[i].Red = (ebmpBYTE) 
+                          ( (1.0-ThetaI-ThetaJ+ThetaI*ThetaJ)*(Old0[I].Red)
+                           +(ThetaI-ThetaI*ThetaJ)*(Old0[I1].Red)   
+                           +(ThetaJ-ThetaI*ThetaJ)*(Old1[I].Red)   
+                           +(ThetaI*ThetaJ)*(Old1[I1].Red) );
+   New[i].Green = (ebmpBYTE) 
+                          ( (1.0-ThetaI-ThetaJ+ThetaI*ThetaJ)*Old0[I].Green
+                           +(ThetaI-ThetaI*ThetaJ)*Old0[I1].Green   
+                           +(ThetaJ-ThetaI*ThetaJ)*Old1[I].Green   
+                           +(ThetaI*ThetaJ)*Old1[I1].Green );  
+   New[i].Blue = (ebmpBYTE) 
+                          ( (1.0-ThetaI-ThetaJ+ThetaI*ThetaJ)*Old0[I].Blue
+                           +(ThetaI-ThetaI*ThetaJ)*Old0[I1].Blue   
+                           +(ThetaJ-ThetaI*ThetaJ)*Old1[I].Blue   
+                           +(ThetaI*ThetaJ)*Old1[I1].Blue ); 
   }
-   InputImage(NewWidth-1,j)->Red = (ebmpBYTE) 
-                            ( (1.0-ThetaJ)*(OldImage(OldWidth-1,J)->Red)
-                          + ThetaJ*(OldImage(OldWidth-1,J+1)->Red) ); 
-   InputImage(NewWidth-1,j)->Green = (ebmpBYTE) 
-                            ( (1.0-ThetaJ)*(OldImage(OldWidth-1,J)->Green)
-                          + ThetaJ*(OldImage(OldWidth-1,J+1)->Green) ); 
-   InputImage(NewWidth-1,j)->Blue = (ebmpBYTE) 
-                            ( (1.0-ThetaJ)*(OldImage(OldWidth-1,J)->Blue)
-                          + ThetaJ*(OldImage(OldWidth-1,J+1)->Blue) ); 
+   New[NewWidth-1].Red = (ebmpBYTE) 
+                            ( (1.0-ThetaJ)*(Old0[OldWidth-1].Red)
+                          + ThetaJ*(Old1[OldWidth-1].Red) ); 
+   New[NewWidth-1].Green = (ebmpBYTE) 
+                            ( (1.0-ThetaJ)*(Old0[OldWidth-1].Green)
+                          + ThetaJ*(Old1[OldWidth-1].Green) ); 
+   New[NewWidth-1].Blue = (ebmpBYTE) 
+                            ( (1.0-ThetaJ)*(Old0[OldWidth-1].Blue)
+                          + ThetaJ*(Old1[OldWidth-1].Blue) ); 
  } 
 
+ const RGBApixel* OldLast = OldImage.RowPointer( OldHeight-1 );
+ RGBApixel* NewLast = InputImage.RowPointer( NewHeight-1 );
  for( int i=0 ; i < NewWidth-1 ; i++ )
  {
   ThetaI = (double)(i*(OldWidth-1.0))
           /(double)(NewWidth-1.0);
   I = (int) floor( ThetaI );
   ThetaI -= I;  
-  InputImage(i,NewHeight-1)->Red = (ebmpBYTE) 
-                            ( (1.0-ThetaI)*(OldImage(I,OldHeight-1)->Red)
-                          + ThetaI*(OldImage(I,OldHeight-1)->Red) ); 
-  InputImage(i,NewHeight-1)->Green = (ebmpBYTE) 
-                            ( (1.0-ThetaI)*(OldImage(I,OldHeight-1)->Green)
-                          + ThetaI*(OldImage(I,OldHeight-1)->Green) ); 
-  InputImage(i,NewHeight-1)->Blue = (ebmpBYTE) 
-                            ( (1.0-ThetaI)*(OldImage(I,OldHeight-1)->Blue)
-                          + ThetaI*(OldImage(I,OldHeight-1)->Blue) ); 
+  NewLast[i].Red = (ebmpBYTE) 
+                            ( (1.0-ThetaI)*(OldLast[I].Red)
+                          + ThetaI*(OldLast[I].Red) ); 
+  NewLast[i].Green = (ebmpBYTE) 
+                            ( (1.0-ThetaI)*(OldLast[I].Green)
+                          + ThetaI*(OldLast[I].Green) ); 
+  NewLast[i].Blue = (ebmpBYTE) 
+                            ( (1.0-ThetaI)*(OldLast[I].Blue)
+                          + ThetaI*(OldLast[I].Blue) ); 
  }
  
  *InputImage(NewWidth-1,NewHeight-1) = *OldImage(OldWidth-1,OldHeight-1);
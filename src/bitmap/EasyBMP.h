@@ -31,6 +31,8 @@
 #include <cmath>
 #include <cctype>
 #include <cstring>
+#include <cstdlib>
+#include <span>
 
 #ifndef EasyBMP
 #define EasyBMP
@@ -24,13 +24,18 @@
 bool SafeFread( char* buffer, int size, int number, FILE* fp );
 bool EasyBMPcheckDataSize( void );
 
+// Fills Buffer with the packed bytes of image row Row (0 is the top row);
+// the row padding is already zero.
+typedef void (*EasyBMProwEncoder)( int Row, ebmpBYTE* Buffer, void* Context );
+
 class BMP
 {private:
 
  int BitDepth;
  int Width;
  int Height;
- RGBApixel** Pixels;
+ // one 64-byte aligned block, row-major: pixel (i,j) is Pixels[j*Width+i]
+ RGBApixel* Pixels;
  RGBApixel* Colors;
  int XPelsPerMeter;
  int YPelsPerMeter;
@@ -53,6 +58,12 @@ class BMP
  bool Write1bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row );
  
  ebmpBYTE FindClosestColor( RGBApixel& input );
+ bool GrayscaleTable;
+ bool HasGrayscaleColorTable( void );
+ ebmpBYTE ClosestColorIndex( RGBApixel& input );
+ void AllocatePixels( int NewWidth, int NewHeight );
+ bool WriteFile( const char* FileName, int FileWidth, int FileHeight,
+                 EasyBMProwEncoder Encode, void* Context );
 
  public: 
 
@@ -71,12 +82,26 @@ class BMP
  
  RGBApixel GetPixel( int i, int j ) const;
  bool SetPixel( int i, int j, RGBApixel NewPixel );
+
+ // unchecked access: no clamping, no warnings
+ RGBApixel& At( int i, int j ) { return Pixels[ (size_t) j*Width + i ]; }
+ const RGBApixel& At( int i, int j ) const { return Pixels[ (size_t) j*Width + i ]; }
+ RGBApixel* RowPointer( int j ) { return Pixels + (size_t) j*Width; }
+ const RGBApixel* RowPointer( int j ) const { return Pixels + (size_t) j*Width; }
+ std::span<RGBApixel> RowSpan( int j ) { return std::span<RGBApixel>( RowPointer(j), Width ); }
+ std::span<const RGBApixel> RowSpan( int j ) const { return std::span<const RGBApixel>( RowPointer(j), Width ); }
+ std::span<RGBApixel> PixelSpan( void ) { return std::span<RGBApixel>( Pixels, (size_t) Width*Height ); }
+ std::span<const RGBApixel> PixelSpan( void ) const { return std::span<const RGBApixel>( Pixels, (size_t) Width*Height ); }
  
  bool CreateStandardColorTable( void );
  
  bool SetSize( int NewWidth, int NewHeight );
  bool SetBitDepth( int NewDepth );
  bool WriteToFile( const char* FileName );
+ // a FileWidth x FileHeight file at the current bit depth and color table,
+ // rows from Encode; Pixels is neither read nor resized (not for 16-bit)
+ bool WriteEncodedToFile( const char* FileName, int FileWidth, int FileHeight,
+                          EasyBMProwEncoder Encode, void* Context );
  bool ReadFromFile( const char* FileName );
  
  RGBApixel GetColor( int ColorNumber );
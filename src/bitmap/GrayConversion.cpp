@@ -0,0 +1,117 @@
+/*
+ * GrayConversion.cpp
+ */
+
+#include "GrayConversion.h"
+#include <immintrin.h>
+#include "../detector/simd.h"
+
+static inline uint8_t luma(int blue, int green, int red) {
+	return (30 * red + 59 * green + 11 * blue) / 100;
+}
+
+// Weighted sums stay below 25500, so they fit in uint16 lanes and x / 100 is
+// exactly (x * 5243) >> 19 over that range.
+__attribute__((target("sse4.1")))
+static inline __m128i lumaX8(__m128i blue, __m128i green, __m128i red) {
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(red, _mm_set1_epi16(30)), _mm_mullo_epi16(green, _mm_set1_epi16(59))),
+	                            _mm_mullo_epi16(blue, _mm_set1_epi16(11)));
+	return _mm_srli_epi16(_mm_mulhi_epu16(sum, _mm_set1_epi16(5243)), 3);
+}
+
+// 8 pixels a step. A 24-bit step reads bytes 0-15 and 8-23: pixels 0-4 come
+// from the first load and 5-7 from the second, so nothing past the 8th pixel
+// is touched.
+__attribute__((target("sse4.1")))
+static int bgrToGraySSE41(const uint8_t *row, uint8_t *gray, int width, int bytesPerPixel) {
+	int j = 0;
+	if(bytesPerPixel == 3) {
+		const __m128i lowB = _mm_setr_epi8(0, -1, 3, -1, 6, -1, 9, -1, 12, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i lowG = _mm_setr_epi8(1, -1, 4, -1, 7, -1, 10, -1, 13, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i lowR = _mm_setr_epi8(2, -1, 5, -1, 8, -1, 11, -1, 14, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i highB = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 7, -1, 10, -1, 13, -1);
+		const __m128i highG = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 8, -1, 11, -1, 14, -1);
+		const __m128i highR = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 9, -1, 12, -1, 15, -1);
+		for(; j + 8 <= width; j += 8) {
+			__m128i low = _mm_loadu_si128((const __m128i *)(row + 3 * j));
+			__m128i high = _mm_loadu_si128((const __m128i *)(row + 3 * j + 8));
+			__m128i blue = _mm_or_si128(_mm_shuffle_epi8(low, lowB), _mm_shuffle_epi8(high, highB));
+			__m128i green = _mm_or_si128(_mm_shuffle_epi8(low, lowG), _mm_shuffle_epi8(high, highG));
+			__m128i red = _mm_or_si128(_mm_shuffle_epi8(low, lowR), _mm_shuffle_epi8(high, highR));
+			__m128i result = lumaX8(blue, green, red);
+			_mm_storel_epi64((__m128i *)(gray + j), _mm_packus_epi16(result, result));
+		}
+	} else {
+		const __m128i maskB = _mm_setr_epi8(0, -1, 4, -1, 8, -1, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i maskG = _mm_setr_epi8(1, -1, 5, -1, 9, -1, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i maskR = _mm_setr_epi8(2, -1, 6, -1, 10, -1, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		for(; j + 8 <= width; j += 8) {
+			__m128i low = _mm_loadu_si128((const __m128i *)(row + 4 * j));
+			__m128i high = _mm_loadu_si128((const __m128i *)(row + 4 * j + 16));
+			__m128i blue = _mm_unpacklo_epi64(_mm_shuffle_epi8(low, maskB), _mm_shuffle_epi8(high, maskB));
+			__m128i green = _mm_unpacklo_epi64(_mm_shuffle_epi8(low, maskG), _mm_shuffle_epi8(high, maskG));
+			__m128i red = _mm_unpacklo_epi64(_mm_shuffle_epi8(low, maskR), _mm_shuffle_epi8(high, maskR));
+			__m128i result = lumaX8(blue, green, red);
+			_mm_storel_epi64((__m128i *)(gray + j), _mm_packus_epi16(result, result));
+		}
+	}
+	return j;
+}
+
+void bgrToGray(const uint8_t *row, uint8_t *gray, int width, int bytesPerPixel) {
+	int j = simd_active_isa() >= ISA_SSE41 ? bgrToGraySSE41(row, gray, width, bytesPerPixel) : 0;
+	for(; j < width; j++) {
+		const uint8_t *p = row + j * bytesPerPixel;
+		gray[j] = luma(p[0], p[1], p[2]);
+	}
+}
+
+// 16 gray values a step, each spread to one 4-byte pixel by a byte shuffle
+// that zeroes alpha.
+__attribute__((target("sse4.1")))
+static int grayToBgraSSE41(const uint8_t *gray, uint8_t *row, int width) {
+	int j = 0;
+	for(; j + 16 <= width; j += 16) {
+		__m128i values = _mm_loadu_si128((const __m128i *)(gray + j));
+		for(int k = 0; k < 4; k++) {
+			char first = 4 * k;
+			__m128i spread = _mm_setr_epi8(first, first, first, -1, first + 1, first + 1, first + 1, -1,
+			                               first + 2, first + 2, first + 2, -1, first + 3, first + 3, first + 3, -1);
+			_mm_storeu_si128((__m128i *)(row + 4 * (j + 4 * k)), _mm_shuffle_epi8(values, spread));
+		}
+	}
+	return j;
+}
+
+void grayToBgra(const uint8_t *gray, uint8_t *row, int width) {
+	int j = simd_active_isa() >= ISA_SSE41 ? grayToBgraSSE41(gray, row, width) : 0;
+	for(; j < width; j++) {
+		row[4 * j] = row[4 * j + 1] = row[4 * j + 2] = gray[j];
+		row[4 * j + 3] = 0;
+	}
+}
+
+// 16 values a step: each 8-byte half is reversed so that movemask, which
+// collects the top bits lowest byte first, puts the leftmost pixel in bit 7.
+__attribute__((target("sse4.1")))
+static int grayToBitsSSE41(const uint8_t *gray, uint8_t *bits, int width) {
+	const __m128i reverse = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	int j = 0;
+	for(; j + 16 <= width; j += 16) {
+		int mask = _mm_movemask_epi8(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(gray + j)), reverse));
+		bits[j / 8] = mask & 0xff;
+		bits[j / 8 + 1] = mask >> 8;
+	}
+	return j;
+}
+
+void grayToBits(const uint8_t *gray, uint8_t *bits, int width) {
+	int j = simd_active_isa() >= ISA_SSE41 ? grayToBitsSSE41(gray, bits, width) : 0;
+	for(; j < width; j += 8) {
+		uint8_t byte = 0;
+		for(int k = 0; k < 8 && j + k < width; k++) {
+			if(gray[j + k] >= 128) byte |= 0x80 >> k;
+		}
+		bits[j / 8] = byte;
+	}
+}
@@ -0,0 +1,26 @@
+/*
+ * GrayConversion.h
+ *
+ * Row kernels between BMP pixel rows and the gray buffers the detectors use.
+ * Both keep BitmapRawConverter's integer luma, (30R + 59G + 11B) / 100, and
+ * give the same bytes whichever ISA runs them.
+ */
+
+#ifndef GRAYCONVERSION_H_
+#define GRAYCONVERSION_H_
+
+#include <cstdint>
+
+// width B, G, R(, A) pixels to gray; bytesPerPixel is 3 or 4, so both file
+// rows and RGBApixel rows can be passed.
+void bgrToGray(const uint8_t *row, uint8_t *gray, int width, int bytesPerPixel);
+
+// width gray values to B, G, R, A pixels with B = G = R and A = 0.
+void grayToBgra(const uint8_t *gray, uint8_t *row, int width);
+
+// width gray values to a 1-bit row, most significant bit first: a bit is set
+// where the value is at least 128, the nearer of black and white. Bits past
+// width in the last byte are zero.
+void grayToBits(const uint8_t *gray, uint8_t *bits, int width);
+
+#endif /* GRAYCONVERSION_H_ */
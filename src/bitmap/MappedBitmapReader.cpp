@@ -0,0 +1,79 @@
+/*
+ * MappedBitmapReader.cpp
+ */
+
+#include "MappedBitmapReader.h"
+#include "GrayConversion.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include "../trace/trace.h"
+#include "../trace/counters.h"
+
+static const int FILE_HEADER_SIZE = 14;
+static const int INFO_HEADER_SIZE = 40;
+
+// Headers are little-endian whatever the host is.
+static uint32_t readLE32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t readLE16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+// Same acceptance rules as BMP::ReadFromFile for 24 and 32-bit files: no
+// compression, positive width and height, pixel data at bfOffBits.
+static bool decodeMapped(const uint8_t *file, size_t size, uint8_t **pixels, int *width, int *height) {
+	if(size < (size_t)(FILE_HEADER_SIZE + INFO_HEADER_SIZE) || file[0] != 'B' || file[1] != 'M') return false;
+	uint32_t offset = readLE32(file + 10);
+	const uint8_t *info = file + FILE_HEADER_SIZE;
+	int32_t fileWidth = (int32_t)readLE32(info + 4);
+	int32_t fileHeight = (int32_t)readLE32(info + 8);
+	int bitDepth = readLE16(info + 14);
+	uint32_t compression = readLE32(info + 16);
+	if(readLE32(info) < (uint32_t)INFO_HEADER_SIZE || (bitDepth != 24 && bitDepth != 32) || compression != 0) return false;
+	if(fileWidth <= 0 || fileHeight <= 0) return false;
+
+	int bytesPerPixel = bitDepth / 8;
+	size_t rowBytes = ((size_t)fileWidth * bytesPerPixel + 3) / 4 * 4;
+	if(offset < (uint32_t)(FILE_HEADER_SIZE + INFO_HEADER_SIZE) || offset > size || (size - offset) / rowBytes < (size_t)fileHeight) return false;
+
+	uint8_t *gray = (uint8_t *) malloc((size_t)fileWidth * fileHeight);
+	if(gray == nullptr) return false;
+	const uint8_t *data = file + offset;
+	tbb::parallel_for(tbb::blocked_range<int>(0, fileHeight), [&](const tbb::blocked_range<int> &r) {
+		for(int y = r.begin(); y < r.end(); y++) {
+			bgrToGray(data + (size_t)(fileHeight - 1 - y) * rowBytes, gray + (size_t)y * fileWidth, fileWidth, bytesPerPixel);
+		}
+	});
+	*pixels = gray;
+	*width = fileWidth;
+	*height = fileHeight;
+	return true;
+}
+
+bool readMappedGray(const char *filename, uint8_t **pixels, int *width, int *height) {
+	trace_span span("readMappedGray");
+	counter_region counters("readMappedGray");
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) return false;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+	size_t size = st.st_size;
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapped == MAP_FAILED) return false;
+	madvise(mapped, size, MADV_WILLNEED);
+	bool decoded = decodeMapped((const uint8_t *)mapped, size, pixels, width, height);
+	munmap(mapped, size);
+	return decoded;
+}
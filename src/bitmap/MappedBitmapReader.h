@@ -0,0 +1,18 @@
+/*
+ * MappedBitmapReader.h
+ *
+ * Fast path for the input image: the BMP is mmapped, its headers validated
+ * and every bottom-up row converted straight into a row-major gray buffer,
+ * rows in parallel. Only uncompressed 24 and 32-bit files are taken; for
+ * anything else readMappedGray returns false and the caller uses EasyBMP.
+ */
+
+#ifndef MAPPEDBITMAPREADER_H_
+#define MAPPEDBITMAPREADER_H_
+
+#include <cstdint>
+
+// On success *pixels is a malloc'ed width * height buffer, top row first.
+bool readMappedGray(const char *filename, uint8_t **pixels, int *width, int *height);
+
+#endif /* MAPPEDBITMAPREADER_H_ */
@@ -0,0 +1,158 @@
+#include "bitplane.h"
+
+using namespace std;
+
+BitPlane::BitPlane(int width, int height)
+    : width(width), height(height), words_per_row((width + 63) / 64), words((size_t)words_per_row * height, 0) {}
+
+// Thresholds a width x height block of a grayscale buffer with the given row stride.
+template<typename T>
+BitPlane::BitPlane(const T *gray, int stride, int width, int height, int threshold) : BitPlane(width, height) {
+    for(int y = 0; y < height; ++y) {
+        const T *line = gray + (size_t)y * stride;
+        uint64_t *out = row(y);
+        for(int k = 0; k < words_per_row; ++k) {
+            int first = k * 64;
+            int count = min(64, width - first);
+            uint64_t word = 0;
+            for(int b = 0; b < count; ++b) {
+                word |= (uint64_t)(line[first + b] >= threshold) << b;
+            }
+            out[k] = word;
+        }
+    }
+}
+
+int BitPlane::get_width() const {
+    return width;
+}
+
+int BitPlane::get_height() const {
+    return height;
+}
+
+int BitPlane::get_words_per_row() const {
+    return words_per_row;
+}
+
+uint64_t *BitPlane::row(int y) {
+    return words.data() + (size_t)y * words_per_row;
+}
+
+const uint64_t *BitPlane::row(int y) const {
+    return words.data() + (size_t)y * words_per_row;
+}
+
+bool BitPlane::get(int x, int y) const {
+    return (row(y)[x / 64] >> (x % 64)) & 1;
+}
+
+void BitPlane::set(int x, int y, bool value) {
+    uint64_t bit = (uint64_t)1 << (x % 64);
+    if(value) row(y)[x / 64] |= bit;
+    else row(y)[x / 64] &= ~bit;
+}
+
+// Word k of a row moved so that bit x holds pixel x + shift. Words outside the
+// row read as fill.
+static uint64_t shifted_word(const uint64_t *line, int words, int k, int shift, uint64_t fill) {
+    int source = k + (shift >= 0 ? shift / 64 : -((-shift + 63) / 64));
+    int bits = ((shift % 64) + 64) % 64;
+    uint64_t low = (source >= 0 && source < words) ? line[source] : fill;
+    if(bits == 0) return low;
+    uint64_t high = (source + 1 >= 0 && source + 1 < words) ? line[source + 1] : fill;
+    return (low >> bits) | (high << (64 - bits));
+}
+
+// Square (2 * radius + 1) window. Dilation ORs the shifted rows, erosion ANDs
+// them; pixels outside the plane are neutral for both, so they never create or
+// remove a foreground pixel.
+BitPlane BitPlane::morphology(int radius, bool dilation) const {
+    uint64_t fill = dilation ? 0 : ~(uint64_t)0;
+    uint64_t tail = (width % 64) ? ((uint64_t)1 << (width % 64)) - 1 : ~(uint64_t)0;
+    BitPlane horizontal(width, height);
+    vector<uint64_t> line(words_per_row);
+
+    for(int y = 0; y < height; ++y) {
+        copy(row(y), row(y) + words_per_row, line.begin());
+        if(!dilation) line[words_per_row - 1] |= ~tail;
+        uint64_t *out = horizontal.row(y);
+        for(int k = 0; k < words_per_row; ++k) {
+            uint64_t word = line[k];
+            for(int shift = 1; shift <= radius; ++shift) {
+                uint64_t left = shifted_word(line.data(), words_per_row, k, -shift, fill);
+                uint64_t right = shifted_word(line.data(), words_per_row, k, shift, fill);
+                word = dilation ? (word | left | right) : (word & left & right);
+            }
+            out[k] = word;
+        }
+    }
+
+    BitPlane result(width, height);
+    for(int y = 0; y < height; ++y) {
+        uint64_t *out = result.row(y);
+        copy(horizontal.row(y), horizontal.row(y) + words_per_row, out);
+        for(int d = max(0, y - radius); d <= min(height - 1, y + radius); ++d) {
+            const uint64_t *other = horizontal.row(d);
+            for(int k = 0; k < words_per_row; ++k) {
+                out[k] = dilation ? (out[k] | other[k]) : (out[k] & other[k]);
+            }
+        }
+        out[words_per_row - 1] &= tail;
+    }
+    return result;
+}
+
+BitPlane BitPlane::dilate(int radius) const {
+    return morphology(radius, true);
+}
+
+BitPlane BitPlane::erode(int radius) const {
+    return morphology(radius, false);
+}
+
+BitPlane BitPlane::open(int radius) const {
+    return erode(radius).dilate(radius);
+}
+
+BitPlane BitPlane::close(int radius) const {
+    return dilate(radius).erode(radius);
+}
+
+BitPlane BitPlane::operator^(const BitPlane &other) const {
+    BitPlane result(width, height);
+    for(size_t k = 0; k < words.size(); ++k) result.words[k] = words[k] ^ other.words[k];
+    return result;
+}
+
+// Writes 255/0 for the block starting at (x, y) into a buffer with the given stride.
+template<typename T>
+void BitPlane::to_pixels(T *output, int stride, int x, int y, int count_w, int count_h) const {
+    for(int i = 0; i < count_h; ++i) {
+        T *out = output + (size_t)i * stride;
+        for(int j = 0; j < count_w; ++j) {
+            out[j] = get(x + j, y + i) ? 255 : 0;
+        }
+    }
+}
+
+// P&O on a bit plane: a pixel is an edge when its window holds both values,
+// which is dilate XOR erode of the thresholded image.
+template<typename T>
+void bitplane_edge_detection(const T *input_matrix, T *output_matrix, int width, int window, pixel_grid grid) {
+    int radius = (window - 1) / 2;
+    int count_w = grid.end_w - grid.start_w;
+    int count_h = grid.end_h - grid.start_h;
+    if(count_w <= 0 || count_h <= 0) return;
+    const T *origin = input_matrix + (grid.start_h - radius) * width + grid.start_w - radius;
+    BitPlane plane(origin, width, count_w + 2 * radius, count_h + 2 * radius, THRESHOLD);
+    BitPlane edges = plane.dilate(radius) ^ plane.erode(radius);
+    edges.to_pixels(output_matrix + grid.start_h * width + grid.start_w, width, radius, radius, count_w, count_h);
+}
+
+template BitPlane::BitPlane(const int *, int, int, int, int);
+template BitPlane::BitPlane(const pixel *, int, int, int, int);
+template void BitPlane::to_pixels<int>(int *, int, int, int, int, int) const;
+template void BitPlane::to_pixels<pixel>(pixel *, int, int, int, int, int) const;
+template void bitplane_edge_detection<int>(const int *, int *, int, int, pixel_grid);
+template void bitplane_edge_detection<pixel>(const pixel *, pixel *, int, int, pixel_grid);
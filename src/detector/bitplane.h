@@ -0,0 +1,44 @@
+#include <cstdint>
+#include <vector>
+#include "kernels.h"
+
+#pragma once
+
+// Binary image, one bit per pixel, 64 pixels per word. Every row starts on a
+// word boundary and bits past the width are kept at zero. Pixel x of a row is
+// bit x % 64 of word x / 64.
+class BitPlane {
+    private:
+        int width;
+        int height;
+        int words_per_row;
+        std::vector<uint64_t> words;
+
+        BitPlane morphology(int, bool) const;
+
+    public:
+        BitPlane(int, int);
+        template<typename T>
+        BitPlane(const T *, int, int, int, int);
+
+        int get_width() const;
+        int get_height() const;
+        int get_words_per_row() const;
+        uint64_t *row(int);
+        const uint64_t *row(int) const;
+
+        bool get(int, int) const;
+        void set(int, int, bool);
+
+        BitPlane dilate(int) const;
+        BitPlane erode(int) const;
+        BitPlane open(int) const;
+        BitPlane close(int) const;
+        BitPlane operator^(const BitPlane &) const;
+
+        template<typename T>
+        void to_pixels(T *, int, int, int, int, int) const;
+};
+
+template<typename T>
+void bitplane_edge_detection(const T *, T *, int, int, pixel_grid);
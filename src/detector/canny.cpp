@@ -0,0 +1,158 @@
+#include "canny.h"
+#include "../trace/trace.h"
+#include "../trace/counters.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+
+using namespace std;
+
+// Integer Gaussian taps, radius ceil(3 * sigma), scaled so the peak is 256.
+vector<int> gaussian_taps(double sigma) {
+    int radius = max(1, (int)ceil(3 * sigma));
+    vector<int> taps;
+    for(int x = -radius; x <= radius; ++x) {
+        taps.push_back((int)lround(256 * exp(-(x * x) / (2 * sigma * sigma))));
+    }
+    return taps;
+}
+
+// Blur radius plus one pixel for the gradient and one for non-maximum suppression.
+int canny_halo(const vector<int> &taps) {
+    return (int)(taps.size() - 1) / 2 + 2;
+}
+
+// 0: horizontal gradient, 1: 45 degrees, 2: vertical, 3: 135 degrees.
+// tan(22.5) ~ 0.4142 and tan(67.5) ~ 2.4142 in fixed point.
+static inline int quantize_direction(int gx, int gy) {
+    long long ax = abs(gx), ay = abs(gy);
+    if(ay * 10000 <= ax * 4142) return 0;
+    if(ay * 10000 >= ax * 24142) return 2;
+    return (gx > 0) == (gy > 0) ? 1 : 3;
+}
+
+// Blur, gradient, non-maximum suppression and the double threshold for one tile,
+// all on scratch that covers the tile plus the halo the next stage needs. The
+// input is read through stride and must have canny_halo(taps) pixels around the
+// tile; the classes are written for the tile only.
+template<typename T>
+void canny_classify(const T *input_matrix, int stride, pixel_grid tile, const vector<int> &taps, canny_params params, uint8_t *classes, int width) {
+    int radius = (taps.size() - 1) / 2;
+    int rows = tile.end_h - tile.start_h, cols = tile.end_w - tile.start_w;
+    if(rows <= 0 || cols <= 0) return;
+    long long norm = 0;
+    for(int tap : taps) norm += tap;
+    norm *= norm;
+
+    static thread_local vector<int> horizontal, blurred, magnitude;
+    static thread_local vector<uint8_t> direction;
+
+    // blurred covers the tile plus 2, horizontal also the blur radius vertically
+    int bw = cols + 4, bh = rows + 4;
+    horizontal.resize((size_t)bw * (bh + 2 * radius));
+    blurred.resize((size_t)bw * bh);
+    for(int r = 0; r < bh + 2 * radius; ++r) {
+        const T *line = input_matrix + (tile.start_h - 2 - radius + r) * stride + tile.start_w - 2;
+        int *out = &horizontal[(size_t)r * bw];
+        for(int x = 0; x < bw; ++x) {
+            int sum = 0;
+            for(int k = -radius; k <= radius; ++k) sum += taps[k + radius] * line[x + k];
+            out[x] = sum;
+        }
+    }
+    for(int r = 0; r < bh; ++r) {
+        int *out = &blurred[(size_t)r * bw];
+        for(int x = 0; x < bw; ++x) {
+            long long sum = 0;
+            for(int k = 0; k < (int)taps.size(); ++k) sum += (long long)taps[k] * horizontal[(size_t)(r + k) * bw + x];
+            out[x] = (int)((sum + norm / 2) / norm);
+        }
+    }
+
+    // gradient over the tile plus 1
+    int gw = cols + 2, gh = rows + 2;
+    magnitude.resize((size_t)gw * gh);
+    direction.resize((size_t)gw * gh);
+    for(int r = 0; r < gh; ++r) {
+        for(int x = 0; x < gw; ++x) {
+            const int *b = &blurred[(size_t)(r + 1) * bw + x + 1];
+            int gx = (b[-bw + 1] + 2 * b[1] + b[bw + 1]) - (b[-bw - 1] + 2 * b[-1] + b[bw - 1]);
+            int gy = (b[bw - 1] + 2 * b[bw] + b[bw + 1]) - (b[-bw - 1] + 2 * b[-bw] + b[-bw + 1]);
+            magnitude[(size_t)r * gw + x] = abs(gx) + abs(gy);
+            direction[(size_t)r * gw + x] = quantize_direction(gx, gy);
+        }
+    }
+
+    // a pixel survives when it is the maximum along its gradient direction,
+    // ties broken towards the first neighbour so plateaus keep one pixel
+    const int offsets[4] = {1, gw + 1, gw, gw - 1};
+    for(int r = 0; r < rows; ++r) {
+        uint8_t *out = classes + (size_t)(tile.start_h + r) * width + tile.start_w;
+        for(int x = 0; x < cols; ++x) {
+            size_t k = (size_t)(r + 1) * gw + x + 1;
+            int m = magnitude[k];
+            int step = offsets[direction[k]];
+            bool peak = m > magnitude[k - step] && m >= magnitude[k + step];
+            out[x] = !peak || m < params.low ? CANNY_NONE : (m >= params.high ? CANNY_STRONG : CANNY_WEAK);
+        }
+    }
+}
+
+// Weak pixels connected to a strong one through 8-neighbours become edges.
+// Level-synchronous parallel BFS: every round promotes the weak neighbours of
+// the current frontier with a compare-and-swap, so each pixel joins exactly one
+// frontier and the result does not depend on scheduling.
+template<typename T>
+void canny_hysteresis(uint8_t *classes, T *output_matrix, int width, int height) {
+    trace_span span("canny_hysteresis");
+    counter_region counters("canny_hysteresis");
+    typedef tbb::enumerable_thread_specific<vector<int>> frontier_parts;
+    frontier_parts parts;
+    tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int> &r) {
+        vector<int> &local = parts.local();
+        for(int y = r.begin(); y < r.end(); ++y) {
+            for(int x = 0; x < width; ++x) {
+                if(classes[(size_t)y * width + x] == CANNY_STRONG) local.push_back(y * width + x);
+            }
+        }
+    });
+
+    vector<int> frontier;
+    while(true) {
+        frontier.clear();
+        for(vector<int> &part : parts) {
+            frontier.insert(frontier.end(), part.begin(), part.end());
+            part.clear();
+        }
+        if(frontier.empty()) break;
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, frontier.size()), [&](const tbb::blocked_range<size_t> &r) {
+            vector<int> &local = parts.local();
+            for(size_t k = r.begin(); k < r.end(); ++k) {
+                int y = frontier[k] / width, x = frontier[k] % width;
+                for(int dy = -1; dy <= 1; ++dy) {
+                    for(int dx = -1; dx <= 1; ++dx) {
+                        int ny = y + dy, nx = x + dx;
+                        if(ny < 0 || ny >= height || nx < 0 || nx >= width) continue;
+                        uint8_t expected = CANNY_WEAK;
+                        atomic_ref<uint8_t> state(classes[(size_t)ny * width + nx]);
+                        if(state.load(memory_order_relaxed) == CANNY_WEAK && state.compare_exchange_strong(expected, CANNY_STRONG)) {
+                            local.push_back(ny * width + nx);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, (size_t)width * height), [&](const tbb::blocked_range<size_t> &r) {
+        for(size_t k = r.begin(); k < r.end(); ++k) output_matrix[k] = classes[k] == CANNY_STRONG ? 255 : 0;
+    });
+}
+
+template void canny_classify<int>(const int *, int, pixel_grid, const vector<int> &, canny_params, uint8_t *, int);
+template void canny_classify<pixel>(const pixel *, int, pixel_grid, const vector<int> &, canny_params, uint8_t *, int);
+template void canny_hysteresis<int>(uint8_t *, int *, int, int);
+template void canny_hysteresis<pixel>(uint8_t *, pixel *, int, int);
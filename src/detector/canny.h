@@ -0,0 +1,22 @@
+#include <cstdint>
+#include <vector>
+#include "kernels.h"
+
+#pragma once
+
+// Gradient thresholds are in |Gx| + |Gy| units of a 3x3 Sobel on the blurred image.
+struct canny_params {
+    double sigma;
+    int low;
+    int high;
+};
+
+enum canny_class : uint8_t { CANNY_NONE = 0, CANNY_WEAK = 1, CANNY_STRONG = 2 };
+
+std::vector<int> gaussian_taps(double);
+int canny_halo(const std::vector<int> &);
+
+template<typename T>
+void canny_classify(const T *, int, pixel_grid, const std::vector<int> &, canny_params, uint8_t *, int);
+template<typename T>
+void canny_hysteresis(uint8_t *, T *, int, int);
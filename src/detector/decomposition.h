@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/blocked_range2d.h>
+#include <tbb/partitioner.h>
+#include "kernels.h"
+#include "../trace/trace.h"
+
+#pragma once
+
+// How a grid is cut into tasks. RANGE_GRID halves the longer axis until a block
+// holds no more than the grain, RANGE_BLOCKED_2D is tbb::blocked_range2d with a
+// square grain, RANGE_ROWS cuts full-width bands of rows.
+enum range_kind { RANGE_GRID, RANGE_BLOCKED_2D, RANGE_ROWS };
+
+enum partitioner_kind { PARTITION_AUTO, PARTITION_SIMPLE, PARTITION_STATIC, PARTITION_AFFINITY };
+
+// A grain derived from the grid aims for this many blocks per hardware thread:
+// enough to even out uneven rows, few enough to keep the task overhead small.
+constexpr long long TASKS_PER_THREAD = 4;
+
+inline long long default_grain(pixel_grid grid) {
+    long long pixels = std::max(0LL, (long long)(grid.end_w - grid.start_w) * (grid.end_h - grid.start_h));
+    long long tasks = TASKS_PER_THREAD * std::max(1u, std::thread::hardware_concurrency());
+    return std::max(1LL, (pixels + tasks - 1) / tasks);
+}
+
+class grid_range {
+    private:
+        pixel_grid grid;
+        long long grain;
+
+        long long rows() const { return grid.end_h - grid.start_h; }
+        long long cols() const { return grid.end_w - grid.start_w; }
+
+    public:
+        grid_range(pixel_grid grid, long long grain) : grid(grid), grain(std::max(1LL, grain)) {}
+
+        grid_range(grid_range &other, tbb::split) : grid(other.grid), grain(other.grain) {
+            if(rows() > cols()) {
+                int middle = grid.start_h + (grid.end_h - grid.start_h) / 2;
+                other.grid.end_h = middle;
+                grid.start_h = middle;
+            }
+            else {
+                int middle = grid.start_w + (grid.end_w - grid.start_w) / 2;
+                other.grid.end_w = middle;
+                grid.start_w = middle;
+            }
+        }
+
+        bool empty() const { return rows() <= 0 || cols() <= 0; }
+        bool is_divisible() const { return rows() * cols() > grain && std::max(rows(), cols()) > 1; }
+        pixel_grid get_grid() const { return grid; }
+};
+
+template<typename Range, typename Body>
+void parallel_for_partitioned(const Range &range, const Body &body, partitioner_kind partitioner, tbb::affinity_partitioner &affinity) {
+    switch(partitioner) {
+        case PARTITION_SIMPLE: tbb::parallel_for(range, body, tbb::simple_partitioner()); break;
+        case PARTITION_STATIC: tbb::parallel_for(range, body, tbb::static_partitioner()); break;
+        case PARTITION_AFFINITY: tbb::parallel_for(range, body, affinity); break;
+        default: tbb::parallel_for(range, body, tbb::auto_partitioner()); break;
+    }
+}
+
+// Runs body(pixel_grid) over blocks of grid holding roughly grain pixels each,
+// every block traced as a task with its extent.
+template<typename Body>
+void parallel_grid(pixel_grid grid, range_kind range, partitioner_kind partitioner, long long grain, tbb::affinity_partitioner &affinity, const Body &body) {
+    if(grid.end_h <= grid.start_h || grid.end_w <= grid.start_w) return;
+    auto traced = [&](pixel_grid g) {
+        trace_span span("task", g);
+        body(g);
+    };
+    switch(range) {
+        case RANGE_BLOCKED_2D: {
+            int side = std::max(1, (int)std::sqrt((double)grain));
+            tbb::blocked_range2d<int> blocks(grid.start_h, grid.end_h, side, grid.start_w, grid.end_w, side);
+            parallel_for_partitioned(blocks, [&](const tbb::blocked_range2d<int> &r) {
+                traced(pixel_grid{r.cols().begin(), r.cols().end(), r.rows().begin(), r.rows().end()});
+            }, partitioner, affinity);
+            break;
+        }
+        case RANGE_ROWS: {
+            int rows = std::max(1LL, grain / (grid.end_w - grid.start_w));
+            tbb::blocked_range<int> bands(grid.start_h, grid.end_h, rows);
+            parallel_for_partitioned(bands, [&](const tbb::blocked_range<int> &r) {
+                traced(pixel_grid{grid.start_w, grid.end_w, r.begin(), r.end()});
+            }, partitioner, affinity);
+            break;
+        }
+        default:
+            parallel_for_partitioned(grid_range(grid, grain), [&](const grid_range &r) {
+                traced(r.get_grid());
+            }, partitioner, affinity);
+            break;
+    }
+}
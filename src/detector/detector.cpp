@@ -1,42 +1,68 @@
 #include "detector.h"
+#include "simd.h"
+#include "running_minmax.h"
+#include "bitplane.h"
+#include "../trace/counters.h"
 #include <iostream>
+#include <type_traits>
+#include <tbb/concurrent_vector.h>
 
 using namespace std;
 using namespace tbb;
 
-Detector::Detector() {}
+Detector::Detector() : filter(nullptr), prewitt_kernels(nullptr, nullptr), grain(0), range(RANGE_GRID), partitioner(PARTITION_AUTO), prewitt_variant(KERNEL_SIMD), edge_variant(KERNEL_SIMD), tiled(TILING_AUTO), tile(tile_shape_for_cache(cache_size(), 0)), border(BORDER_NONE), border_value(0), canny({1.4, THRESHOLD / 2, THRESHOLD}), norm(NORM_L1) {
+    set_filter("prewitt3");
+    load_tuning(tuning_path(), &this->tuning);
+}
 
 void Detector::start_detector(){
     vector<char*> images = {"../resources/color.bmp",
                             "../resources/serial_prewitt.bmp",
                             "../resources/serial_edge.bmp",
                             "../resources/parallel_prewitt.bmp",
-                            "../resources/parallel_edge.bmp"};
+                            "../resources/parallel_edge.bmp",
+                            "../resources/canny.bmp"};
 
-	BitmapRawConverter inputFile(images[0]);
-	BitmapRawConverter outputFileSerialPrewitt(images[1]);
-    BitmapRawConverter outputFileSerialEdge(images[2]);
-	BitmapRawConverter outputFileParallelPrewitt(images[3]);
-    BitmapRawConverter outputFileParallelEdge(images[4]);
+	// decoded once, every run reads the same gray buffer; the writers never read a file
+	const BitmapRawConverter inputFile(images[0]);
+	const pixel *input = inputFile.getBuffer();
 
     int width = inputFile.getWidth();
     int height = inputFile.getHeight();
 
-	int* outBufferSerialPrewitt = new int[width * height];
-	int* outBufferParallelPrewitt = new int[width * height];
-	int* outBufferSerialEdge = new int[width * height];
-	int* outBufferParallelEdge = new int[width * height];
+	BitmapRawConverter outputFileSerialPrewitt(width, height);
+    BitmapRawConverter outputFileSerialEdge(width, height);
+	BitmapRawConverter outputFileParallelPrewitt(width, height);
+    BitmapRawConverter outputFileParallelEdge(width, height);
+    BitmapRawConverter outputFileCanny(width, height);
+    // every result is a 0/255 mask, so 1-bit files lose nothing
+    for(BitmapRawConverter *output : {&outputFileSerialPrewitt, &outputFileSerialEdge, &outputFileParallelPrewitt, &outputFileParallelEdge, &outputFileCanny}) {
+        output->setBitDepth(1);
+    }
+
+	pixel* outBufferSerialPrewitt = new pixel[width * height];
+	pixel* outBufferParallelPrewitt = new pixel[width * height];
+	pixel* outBufferSerialEdge = new pixel[width * height];
+	pixel* outBufferParallelEdge = new pixel[width * height];
+	pixel* outBufferCanny = new pixel[width * height];
 
-    memset(outBufferSerialPrewitt, 0x0, width * height * sizeof(int));
-    memset(outBufferParallelPrewitt, 0x0, width * height * sizeof(int));
-	memset(outBufferSerialEdge, 0x0, width * height * sizeof(int));
-	memset(outBufferParallelEdge, 0x0, width * height * sizeof(int));
+    memset(outBufferSerialPrewitt, 0x0, width * height * sizeof(pixel));
+    memset(outBufferParallelPrewitt, 0x0, width * height * sizeof(pixel));
+	memset(outBufferSerialEdge, 0x0, width * height * sizeof(pixel));
+	memset(outBufferParallelEdge, 0x0, width * height * sizeof(pixel));
 
     set_image_width(width);
     set_image_height(height);
-    set_cutoff(800);
     set_filter_size(5);
     set_area(1);
+    const tuning_entry *tuned = apply_tuning();
+    if(tuned != nullptr) {
+        cout << "Tuning: grain " << tuned->grain << ", prewitt " << kernel_variant_name(tuned->prewitt_variant) << ", edge "
+             << kernel_variant_name(tuned->edge_variant) << " (measured at " << tuned->width << "x" << tuned->height << ")" << endl;
+    }
+    set_border(DETECTOR_BORDER, 0);
+    // padded once for the filter and window, every padded run reuses it
+    const Image<pixel> padded = pad(input);
 
     int offset = (this->filter_size-1)/2;
     pixel_grid grid;
@@ -45,177 +71,495 @@ void Detector::start_detector(){
     grid.end_h = height - offset;
     grid.end_w = width - offset;
 
-	run_test_nr(1, &outputFileSerialPrewitt, images[1], outBufferSerialPrewitt,grid);
-    run_test_nr(2, &outputFileParallelPrewitt, images[3], outBufferParallelPrewitt, grid);
-	run_test_nr(3, &outputFileSerialEdge, images[2], outBufferSerialEdge, grid);
-	run_test_nr(4, &outputFileParallelEdge, images[4], outBufferParallelEdge, grid);
+    // the P&O window may reach further out than the Prewitt filter
+    int edge_offset = max(offset, (this->area - 1) / 2);
+    pixel_grid edge_grid;
+    edge_grid.start_h = edge_offset;
+    edge_grid.start_w = edge_offset;
+    edge_grid.end_h = height - edge_offset;
+    edge_grid.end_w = width - edge_offset;
+
+    cout << "Kernel ISA: " << simd_isa_name(simd_active_isa()) << endl;
+
+	run_test_nr(1, input, padded, &outputFileSerialPrewitt, images[1], outBufferSerialPrewitt,grid);
+    run_test_nr(2, input, padded, &outputFileParallelPrewitt, images[3], outBufferParallelPrewitt, grid);
+	run_test_nr(3, input, padded, &outputFileSerialEdge, images[2], outBufferSerialEdge, edge_grid);
+	run_test_nr(4, input, padded, &outputFileParallelEdge, images[4], outBufferParallelEdge, edge_grid);
+	run_test_nr(5, input, padded, &outputFileCanny, images[5], outBufferCanny, grid);
+
+	pixel* outBufferFusedPrewitt = new pixel[width * height];
+	pixel* outBufferFusedEdge = new pixel[width * height];
+	// without a border the fused pass covers edge_grid only, keep the serial Prewitt frame around it
+	memcpy(outBufferFusedPrewitt, outBufferSerialPrewitt, width * height * sizeof(pixel));
+	memset(outBufferFusedEdge, 0x0, width * height * sizeof(pixel));
+	vector<tile_stats> stats;
+	cout << "Running fused Prewitt and edge detection" << endl;
+	auto start = std::chrono::high_resolution_clock::now();
+	if(this->border == BORDER_NONE) fused_detection(input, outBufferFusedPrewitt, outBufferFusedEdge, &stats, edge_grid);
+	else padded_fused_detection(padded, outBufferFusedPrewitt, outBufferFusedEdge, &stats);
+	auto end = std::chrono::high_resolution_clock::now();
+	long long gray_sum = 0, gray_count = 0;
+	for(const tile_stats &s : stats) {
+		gray_sum += s.sum;
+		gray_count += (long long)(s.tile.end_w - s.tile.start_w) * (s.tile.end_h - s.tile.start_h);
+	}
+	cout << "Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " | Tiles: " << stats.size()
+	     << " | Mean gray: " << (gray_count ? gray_sum / gray_count : 0) << "." << endl;
+
+	// the gradient is kept once, any threshold is then a single pass over it
+	gradient* magnitude = new gradient[width * height]();
+	pixel* outBufferThreshold = new pixel[width * height];
+	cout << "Running Prewitt gradient magnitude" << endl;
+	start = std::chrono::high_resolution_clock::now();
+	if(this->border == BORDER_NONE) prewitt_magnitude(input, magnitude, grid);
+	else padded_prewitt_magnitude(padded, magnitude);
+	end = std::chrono::high_resolution_clock::now();
+	auto threshold_start = std::chrono::high_resolution_clock::now();
+	threshold_magnitude(magnitude, outBufferThreshold, THRESHOLD);
+	auto threshold_end = std::chrono::high_resolution_clock::now();
+	cout << "Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+	     << " | Threshold: " << std::chrono::duration_cast<std::chrono::microseconds>(threshold_end - threshold_start).count() << "us." << endl;
+
+	// every window is computed once for the whole threshold list
+	vector<int> thresholds;
+	for(int t = 4; t <= 256; t += 4) thresholds.push_back(t);
+	threshold_sweep prewitt_sweep_result = make_sweep(thresholds, width, height);
+	threshold_sweep edge_sweep_result = make_sweep(thresholds, width, height);
+	cout << "Running threshold sweep" << endl;
+	start = std::chrono::high_resolution_clock::now();
+	if(this->border == BORDER_NONE) prewitt_sweep(input, &prewitt_sweep_result, grid);
+	else padded_prewitt_sweep(padded, &prewitt_sweep_result);
+	auto middle = std::chrono::high_resolution_clock::now();
+	if(this->border == BORDER_NONE) edge_sweep(input, &edge_sweep_result, edge_grid);
+	else padded_edge_sweep(padded, &edge_sweep_result);
+	end = std::chrono::high_resolution_clock::now();
+	int at_threshold = find(thresholds.begin(), thresholds.end(), THRESHOLD) - thresholds.begin();
+	cout << "Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(middle - start).count()
+	     << " + " << std::chrono::duration_cast<std::chrono::milliseconds>(end - middle).count()
+	     << " | Thresholds: " << thresholds.size()
+	     << " | Edges at " << THRESHOLD << ": " << prewitt_sweep_result.counts[at_threshold] << " / " << edge_sweep_result.counts[at_threshold] << "." << endl;
+	pixel* outBufferSweepPrewitt = new pixel[width * height];
+	pixel* outBufferSweepEdge = new pixel[width * height];
+	prewitt_sweep_result.planes[at_threshold].to_pixels(outBufferSweepPrewitt, width, 0, 0, width, height);
+	edge_sweep_result.planes[at_threshold].to_pixels(outBufferSweepEdge, width, 0, 0, width, height);
 
 	cout << "Verification: ";
-	auto test = memcmp(outBufferSerialPrewitt, outBufferParallelPrewitt, width * height * sizeof(int));
+	auto test = memcmp(outBufferSerialPrewitt, outBufferParallelPrewitt, width * height * sizeof(pixel));
 	if(test != 0) { cout << "Prewitt FAIL!" << endl; } else { cout << "Prewitt PASS." << endl; }
-	test = memcmp(outBufferSerialEdge, outBufferParallelEdge, width * height * sizeof(int));
+	test = memcmp(outBufferSerialEdge, outBufferParallelEdge, width * height * sizeof(pixel));
 	if(test != 0) { cout << "Edge detection FAIL!" << endl; } else { cout << "Edge detection PASS." << endl; }
+	test = memcmp(outBufferSerialPrewitt, outBufferFusedPrewitt, width * height * sizeof(pixel)) | memcmp(outBufferSerialEdge, outBufferFusedEdge, width * height * sizeof(pixel));
+	if(test != 0) { cout << "Fused FAIL!" << endl; } else { cout << "Fused PASS." << endl; }
+	test = memcmp(outBufferSerialPrewitt, outBufferThreshold, width * height * sizeof(pixel));
+	if(test != 0) { cout << "Magnitude FAIL!" << endl; } else { cout << "Magnitude PASS." << endl; }
+	test = memcmp(outBufferSerialPrewitt, outBufferSweepPrewitt, width * height * sizeof(pixel)) | memcmp(outBufferSerialEdge, outBufferSweepEdge, width * height * sizeof(pixel));
+	if(test != 0) { cout << "Sweep FAIL!" << endl; } else { cout << "Sweep PASS." << endl; }
 
-	delete outBufferSerialPrewitt;
-	delete outBufferParallelPrewitt;
-	delete outBufferSerialEdge;
-	delete outBufferParallelEdge;
+	delete[] outBufferSerialPrewitt;
+	delete[] outBufferParallelPrewitt;
+	delete[] outBufferSerialEdge;
+	delete[] outBufferParallelEdge;
+	delete[] outBufferCanny;
+	delete[] outBufferFusedPrewitt;
+	delete[] outBufferFusedEdge;
+	delete[] magnitude;
+	delete[] outBufferThreshold;
+	delete[] outBufferSweepPrewitt;
+	delete[] outBufferSweepEdge;
 
 }
 
-void Detector::run_test_nr(int test_number, BitmapRawConverter* io_file, char* out_file_name, int* out_buffer, pixel_grid grid) {
+// Grain and kernel variants from the machine's tuning profile, picked by image
+// size for the current filter and window. Without a matching entry the
+// defaults stay and nullptr is returned.
+const tuning_entry *Detector::apply_tuning() {
+    const tuning_entry *entry = find_tuning(this->tuning, this->filter->name, this->image_width, this->image_height, this->area);
+    if(entry == nullptr) return nullptr;
+    this->grain = entry->grain;
+    if(!this->filter->compass) this->prewitt_variant = entry->prewitt_variant;
+    this->edge_variant = entry->edge_variant;
+    return entry;
+}
+
+void Detector::run_test_nr(int test_number, const pixel* input, const Image<pixel> &padded, BitmapRawConverter* io_file, char* out_file_name, pixel* out_buffer, pixel_grid grid) {
+    static const char *names[] = {"test 1: serial Prewitt", "test 2: parallel Prewitt", "test 3: serial edge detection", "test 4: parallel edge detection", "test 5: Canny"};
+    trace_span span(test_number >= 1 && test_number <= 5 ? names[test_number - 1] : "run_test_nr");
+    counter_region counters(test_number >= 1 && test_number <= 5 ? names[test_number - 1] : "run_test_nr");
     auto start = std::chrono::high_resolution_clock::now();
 	switch (test_number)
 	{
 		case 1:
             cout << "Running serial version of edge detection using Prewitt operator" << endl;
-            this->serial_prewitt(io_file->getBuffer(), out_buffer, grid);
+            if(this->border == BORDER_NONE) this->serial_prewitt(input, out_buffer, grid);
+            else this->padded_prewitt(padded, out_buffer, false);
 			break;
 		case 2:
 			cout << "Running parallel version of edge detection using Prewitt operator" << endl;
-			this->parallel_prewitt(io_file->getBuffer(), out_buffer,grid);
+			if(this->border == BORDER_NONE) this->parallel_prewitt(input, out_buffer,grid);
+			else this->padded_prewitt(padded, out_buffer, true);
 			break;
 		case 3:
 			cout << "Running serial version of edge detection" << endl;
-			this->serial_edge_detection(io_file->getBuffer(), out_buffer, grid);
+			if(this->border == BORDER_NONE) this->serial_edge_detection(input, out_buffer, grid);
+			else this->padded_edge_detection(padded, out_buffer, false);
 			break;
 		case 4:
 			cout << "Running parallel version of edge detection" << endl;
-			this->parallel_edge_detection(io_file->getBuffer(), out_buffer,grid);
+			if(this->border == BORDER_NONE) this->parallel_edge_detection(input, out_buffer,grid);
+			else this->padded_edge_detection(padded, out_buffer, true);
+			break;
+		case 5:
+			cout << "Running Canny edge detection" << endl;
+			this->canny_detection(input, out_buffer);
 			break;
 		default:
-			cout << "ERROR: invalid test case, must be 1, 2, 3 or 4!";
+			cout << "ERROR: invalid test case, must be 1, 2, 3, 4 or 5!";
 			break;
 	}
     auto end = std::chrono::high_resolution_clock::now();
     auto time_took = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 	io_file->setBuffer(out_buffer);
 	io_file->pixelsToBitmap(out_file_name);
-    cout <<"Time: " << time_took <<  " | Cutoff: " << this->cutoff << " | Distance:  " << this->filter_size <<  " | Area: "<< this->area << "."<<  endl; 
+    cout <<"Time: " << time_took <<  " | Grain: " << get_grain() << " | Distance:  " << this->filter_size <<  " | Area: "<< this->area << "."<<  endl; 
 }
 
-int prewitt_convolve(int *input_matrix, const int *filter_h, const int *filter_v, int x, int y, int picture_size, int filter_size) {
-    int picture_offset = (filter_size - 1) / 2;
-    int vertical_sum = 0, horizontal_sum = 0;
-    for(int i = 0; i < filter_size; ++i) {
-        for(int j = 0; j < filter_size; ++j) {
-            vertical_sum += filter_v[i * filter_size + j] * input_matrix[(x - picture_offset + i) * picture_size + (y - picture_offset + j)];
-            horizontal_sum += filter_h[i * filter_size +j] * input_matrix[(x - picture_offset + i) * picture_size + (y - picture_offset + j)];
-        }
-    }
-    return (abs(horizontal_sum) + abs(vertical_sum)) > THRESHOLD ? 255 : 0;
+template<typename T>
+void Detector::serial_prewitt(const T *input_matrix, T *output_matrix, pixel_grid grid) {
+    prewitt_region(input_matrix, output_matrix, this->image_width, grid, false);
 }
 
-int edge_detection_p_and_o(int *input_matrix, int width, int x, int y, int filter_size){
-    int p = 0, o = 1;
-    int picture_offset = (filter_size - 1) / 2;
-    for(int i =0; i < filter_size; i++) {
-        for(int j = 0; j < filter_size; j++) {
-            if(input_matrix[(x - picture_offset + i) * width + (y - picture_offset + j)] >= THRESHOLD) p = 1;
-            if(input_matrix[(x - picture_offset + i) * width + (y - picture_offset + j)] < THRESHOLD) o = 0;
-        }
+template<typename T>
+void Detector::parallel_prewitt(const T *input_matrix, T *output_matrix, pixel_grid grid) {
+    prewitt_region(input_matrix, output_matrix, this->image_width, grid, true);
+}
+
+template<typename T>
+void Detector::padded_prewitt(const Image<T> &source, T *output_matrix, bool parallel) {
+    if(!halo_fits(source.get_halo(), (this->filter_size - 1) / 2)) return;
+    Image<T> target(this->image_width, this->image_height, source.get_halo());
+    prewitt_region(source.origin(), target.origin(), source.get_stride(), source.grid(), parallel);
+    target.store(output_matrix);
+}
+
+template<typename T>
+void Detector::prewitt_region(const T *input_matrix, T *output_matrix, int width, pixel_grid grid, bool parallel) {
+    if(parallel) {
+        parallel_grid(grid, this->range, this->partitioner, grain_for(grid), this->affinity, [&](pixel_grid g) {
+            prewitt_region(input_matrix, output_matrix, width, g, false);
+        });
+        return;
+    }
+    if(!tiled_for(grid, sizeof(T))) {
+        prewitt_helper(input_matrix, output_matrix, width, grid);
+        return;
     }
-    return abs(p-o) == 1 ? 255: 0;
+    int halo = (this->filter_size - 1) / 2;
+    tiled_run(input_matrix, output_matrix, width, halo, grid, this->tile, [&](const T *in, T *out, int stride, pixel_grid g) {
+        prewitt_helper(in, out, stride, g);
+    });
 }
 
-void Detector::serial_prewitt(int *input_matrix, int *output_matrix, pixel_grid grid) {
+template<typename T>
+void Detector::prewitt_helper(const T *input_matrix, T *output_matrix, int width, pixel_grid grid) {
+    if(this->filter->compass) {
+        compass_gradient(input_matrix, output_matrix, *this->filter, width, grid);
+        return;
+    }
+    switch(this->prewitt_variant) {
+        case KERNEL_SIMD:
+            if constexpr(is_same_v<T, pixel>) {
+                if(this->filter->fits_int16) {
+                    simd_prewitt_narrow(input_matrix, output_matrix, this->filter->taps.data(), this->filter->taps.size(), this->filter->antisymmetric, width, grid);
+                    return;
+                }
+            }
+            simd_prewitt(input_matrix, output_matrix, this->filter_h, this->filter_v, width, this->filter_size, grid);
+            return;
+        case KERNEL_UNROLLED:
+            if(get<prewitt_fixed_fn<T>>(this->prewitt_kernels) == nullptr) break;
+            get<prewitt_fixed_fn<T>>(this->prewitt_kernels)(input_matrix, output_matrix, width, grid);
+            return;
+        case KERNEL_SEPARABLE:
+            if(!this->separable_h.valid || !this->separable_v.valid) break;
+            separable_prewitt(input_matrix, output_matrix, this->separable_h, this->separable_v, width, grid);
+            return;
+        default:
+            break;
+    }
     for(int i = grid.start_h; i < grid.end_h; ++i) {
         for(int j = grid.start_w; j < grid.end_w; ++j) {
-            output_matrix[i * this->image_width + j] = prewitt_convolve(input_matrix, this->filter_h, this->filter_v, i, j, this->image_width, this->filter_size);
+            output_matrix[i * width + j] = prewitt_convolve(input_matrix, this->filter_h, this->filter_v, i, j, width, this->filter_size);
         }
     }
 }
 
-void Detector::parallel_prewitt(int *input_matrix, int *output_matrix, pixel_grid grid) {
-    if (abs(grid.end_w - grid.start_w) <= this->cutoff || abs(grid.end_h - grid.start_h) <= this->cutoff){
-        serial_prewitt(input_matrix, output_matrix, grid);
-    }
-    else {
-        task_group tg;
-        tg.run([&]() {
-                pixel_grid g;
-                g.start_w = grid.start_w;
-                g.end_w = grid.start_w + (grid.end_w - grid.start_w) / 2;
-                g.start_h = grid.start_h;
-                g.end_h = grid.start_h + (grid.end_h - grid.start_h) / 2;
-                parallel_prewitt(input_matrix, output_matrix, g);
-        });
-        tg.run([&]() {
-                pixel_grid g;
-                g.start_w = grid.start_w;
-                g.end_w = grid.start_w + (grid.end_w - grid.start_w) / 2;
-                g.start_h = grid.start_h + (grid.end_h - grid.start_h) / 2;
-                g.end_h = grid.end_h;
-                parallel_prewitt(input_matrix, output_matrix, g);
-        });
-        tg.run([&]() {
-                pixel_grid g;
-                g.start_w = grid.start_w + (grid.end_w - grid.start_w) / 2;
-                g.end_w = grid.end_w;
-                g.start_h = grid.start_h;
-                g.end_h = grid.start_h + (grid.end_h - grid.start_h) / 2;
-                parallel_prewitt(input_matrix, output_matrix, g);
-        });
-        tg.run([&]() {
-                pixel_grid g;
-                g.start_w = grid.start_w + (grid.end_w - grid.start_w) / 2;
-                g.end_w = grid.end_w;
-                g.start_h = grid.start_h + (grid.end_h - grid.start_h) / 2;
-                g.end_h = grid.end_h;
-                parallel_prewitt(input_matrix, output_matrix, g);
+template<typename T>
+void Detector::serial_edge_detection(const T *input_matrix, T *output_matrix, pixel_grid grid) {
+    edge_detection_region(input_matrix, output_matrix, this->image_width, grid, false);
+}
+
+template<typename T>
+void Detector::parallel_edge_detection(const T *input_matrix, T *output_matrix, pixel_grid grid) {
+    edge_detection_region(input_matrix, output_matrix, this->image_width, grid, true);
+}
+
+template<typename T>
+void Detector::padded_edge_detection(const Image<T> &source, T *output_matrix, bool parallel) {
+    if(!halo_fits(source.get_halo(), (this->area - 1) / 2)) return;
+    Image<T> target(this->image_width, this->image_height, source.get_halo());
+    edge_detection_region(source.origin(), target.origin(), source.get_stride(), source.grid(), parallel);
+    target.store(output_matrix);
+}
+
+template<typename T>
+void Detector::edge_detection_region(const T *input_matrix, T *output_matrix, int width, pixel_grid grid, bool parallel) {
+    if(parallel) {
+        parallel_grid(grid, this->range, this->partitioner, grain_for(grid), this->affinity, [&](pixel_grid g) {
+            edge_detection_region(input_matrix, output_matrix, width, g, false);
         });
-        tg.wait();
+        return;
+    }
+    if(!tiled_for(grid, sizeof(T))) {
+        edge_detection_helper(input_matrix, output_matrix, width, grid);
+        return;
     }
+    int halo = (this->area - 1) / 2;
+    tiled_run(input_matrix, output_matrix, width, halo, grid, this->tile, [&](const T *in, T *out, int stride, pixel_grid g) {
+        edge_detection_helper(in, out, stride, g);
+    });
 }
 
-void Detector::serial_edge_detection(int *input_matrix, int *output_matrix, pixel_grid grid) {
+template<typename T>
+void Detector::edge_detection_helper(const T *input_matrix, T *output_matrix, int width, pixel_grid grid) {
+    switch(this->edge_variant) {
+        case KERNEL_SIMD:
+            simd_edge_detection(input_matrix, output_matrix, width, this->area, grid);
+            return;
+        case KERNEL_RUNNING:
+            running_edge_detection(input_matrix, output_matrix, width, this->area, grid);
+            return;
+        case KERNEL_BITPLANE:
+            bitplane_edge_detection(input_matrix, output_matrix, width, this->area, grid);
+            return;
+        default:
+            break;
+    }
     for(int i = grid.start_h; i < grid.end_h; ++i) {
         for(int j = grid.start_w; j < grid.end_w; ++j) {
-            output_matrix[i * this->image_width + j] = edge_detection_p_and_o(input_matrix, this->image_width, i, j, this->area) ;
+            output_matrix[i * width + j] = edge_detection_p_and_o(input_matrix, width, i, j, this->area) ;
         }
     }
 }
 
-void Detector::parallel_edge_detection(int *input_matrix, int *output_matrix, pixel_grid grid) {
-    if (abs(grid.end_w - grid.start_w) <= this->cutoff || abs(grid.end_h - grid.start_h) <= this->cutoff){
-        serial_edge_detection(input_matrix, output_matrix, grid);
-    }
-    else {
-        task_group tg;
-        tg.run([&]() {
-                pixel_grid g;
-                g.start_w = grid.start_w;
-                g.end_w = grid.start_w + (grid.end_w - grid.start_w) / 2;
-                g.start_h = grid.start_h;
-                g.end_h = grid.start_h + (grid.end_h - grid.start_h) / 2;
-                parallel_edge_detection(input_matrix, output_matrix, g);
-        });
-        tg.run([&]() {
-                pixel_grid g;
-                g.start_w = grid.start_w;
-                g.end_w = grid.start_w + (grid.end_w - grid.start_w) / 2;
-                g.start_h = grid.start_h + (grid.end_h - grid.start_h) / 2;
-                g.end_h = grid.end_h;
-                parallel_edge_detection(input_matrix, output_matrix, g);
+template<typename T>
+void Detector::fused_detection(const T *input_matrix, T *prewitt_matrix, T *edge_matrix, vector<tile_stats> *stats, pixel_grid grid) {
+    fused_region(input_matrix, prewitt_matrix, edge_matrix, this->image_width, stats, grid);
+}
+
+template<typename T>
+void Detector::padded_fused_detection(const Image<T> &source, T *prewitt_matrix, T *edge_matrix, vector<tile_stats> *stats) {
+    if(!halo_fits(source.get_halo(), max((this->filter_size - 1) / 2, (this->area - 1) / 2))) return;
+    Image<T> prewitt_target(this->image_width, this->image_height, source.get_halo());
+    Image<T> edge_target(this->image_width, this->image_height, source.get_halo());
+    fused_region(source.origin(), prewitt_target.origin(), edge_target.origin(), source.get_stride(), stats, source.grid());
+    prewitt_target.store(prewitt_matrix);
+    edge_target.store(edge_matrix);
+}
+
+// Prewitt and P&O from a single load of every tile. The halo covers both
+// windows, so grid must leave room for the larger one. Stats are gathered from
+// the tile while it is in cache and returned sorted by tile position.
+template<typename T>
+void Detector::fused_region(const T *input_matrix, T *prewitt_matrix, T *edge_matrix, int width, vector<tile_stats> *stats, pixel_grid grid) {
+    trace_span span("fused_detection");
+    counter_region counters("fused_detection");
+    int halo = max((this->filter_size - 1) / 2, (this->area - 1) / 2);
+    concurrent_vector<tile_stats> collected;
+    parallel_grid(grid, this->range, this->partitioner, grain_for(grid), this->affinity, [&](pixel_grid block) {
+        tiled_run_fused(input_matrix, prewitt_matrix, edge_matrix, width, halo, block, this->tile,
+                        [&](const T *in, T *prewitt_out, T *edge_out, int stride, pixel_grid g, pixel_grid tile) {
+            prewitt_helper(in, prewitt_out, stride, g);
+            edge_detection_helper(in, edge_out, stride, g);
+            if(stats == nullptr) return;
+            tile_stats s = {tile, 255, 0, 0, 0};
+            for(int i = g.start_h; i < g.end_h; ++i) {
+                for(int j = g.start_w; j < g.end_w; ++j) {
+                    int value = in[i * stride + j];
+                    s.min = min(s.min, value);
+                    s.max = max(s.max, value);
+                    s.sum += value;
+                    s.sum_squares += (long long)value * value;
+                }
+            }
+            collected.push_back(s);
         });
-        tg.run([&]() {
-                pixel_grid g;
-                g.start_w = grid.start_w + (grid.end_w - grid.start_w) / 2;
-                g.end_w = grid.end_w;
-                g.start_h = grid.start_h;
-                g.end_h = grid.start_h + (grid.end_h - grid.start_h) / 2;
-                parallel_edge_detection(input_matrix, output_matrix, g);
+    });
+    if(stats == nullptr) return;
+    stats->assign(collected.begin(), collected.end());
+    sort(stats->begin(), stats->end(), [](const tile_stats &a, const tile_stats &b) {
+        return a.tile.start_h != b.tile.start_h ? a.tile.start_h < b.tile.start_h : a.tile.start_w < b.tile.start_w;
+    });
+}
+
+// Blur, gradient, non-maximum suppression and the double threshold run fused
+// per tile over the padded image, hysteresis then runs over the whole frame.
+// Canny always needs a border, replicate is used when none is set.
+template<typename T>
+void Detector::canny_detection(const T *input_matrix, T *output_matrix) {
+    trace_span span("canny_detection");
+    counter_region counters("canny_detection");
+    vector<int> taps = gaussian_taps(this->canny.sigma);
+    Image<T> source(this->image_width, this->image_height, canny_halo(taps));
+    source.load(input_matrix);
+    source.fill_border(this->border == BORDER_NONE ? BORDER_REPLICATE : this->border, (T)this->border_value);
+    vector<uint8_t> classes((size_t)this->image_width * this->image_height);
+    pixel_grid grid = {0, this->image_width, 0, this->image_height};
+    parallel_grid(grid, this->range, this->partitioner, grain_for(grid), this->affinity, [&](pixel_grid block) {
+        for(int i = block.start_h; i < block.end_h; i += this->tile.height) {
+            for(int j = block.start_w; j < block.end_w; j += this->tile.width) {
+                pixel_grid g = {j, min(j + this->tile.width, block.end_w), i, min(i + this->tile.height, block.end_h)};
+                canny_classify(source.origin(), source.get_stride(), g, taps, this->canny, classes.data(), this->image_width);
+            }
+        }
+    });
+    canny_hysteresis(classes.data(), output_matrix, this->image_width, this->image_height);
+}
+
+template<typename T>
+void Detector::prewitt_magnitude(const T *input_matrix, gradient *magnitude, pixel_grid grid) {
+    magnitude_region(input_matrix, magnitude, this->image_width, grid);
+}
+
+template<typename T>
+void Detector::padded_prewitt_magnitude(const Image<T> &source, gradient *magnitude) {
+    if(!halo_fits(source.get_halo(), (this->filter_size - 1) / 2)) return;
+    Image<gradient> target(this->image_width, this->image_height, source.get_halo());
+    magnitude_region(source.origin(), target.origin(), source.get_stride(), source.grid());
+    target.store(magnitude);
+}
+
+template<typename T>
+void Detector::magnitude_region(const T *input_matrix, gradient *magnitude, int width, pixel_grid grid) {
+    trace_span span("prewitt_magnitude");
+    counter_region counters("prewitt_magnitude");
+    parallel_grid(grid, this->range, this->partitioner, grain_for(grid), this->affinity, [&](pixel_grid g) {
+        gradient_magnitude(input_matrix, magnitude, *this->filter, this->norm, width, g);
+    });
+}
+
+// Memory-bound pass: output is 255 where the stored gradient exceeds threshold.
+template<typename T>
+void Detector::threshold_magnitude(const gradient *magnitude, T *output_matrix, int threshold) {
+    trace_span span("threshold_magnitude");
+    counter_region counters("threshold_magnitude");
+    pixel_grid grid = {0, this->image_width, 0, this->image_height};
+    parallel_grid(grid, this->range, this->partitioner, grain_for(grid), this->affinity, [&](pixel_grid g) {
+        simd_threshold(magnitude, output_matrix, threshold, this->image_width, g);
+    });
+}
+
+template<typename T>
+void Detector::prewitt_sweep(const T *input_matrix, threshold_sweep *sweep, pixel_grid grid) {
+    prewitt_sweep_region(input_matrix, this->image_width, grid, sweep);
+}
+
+template<typename T>
+void Detector::padded_prewitt_sweep(const Image<T> &source, threshold_sweep *sweep) {
+    if(!halo_fits(source.get_halo(), (this->filter_size - 1) / 2)) return;
+    prewitt_sweep_region(source.origin(), source.get_stride(), source.grid(), sweep);
+}
+
+// The gradient of each tile is swept while the tile is still in cache. Bands
+// of whole rows go to the threads, so no two of them share a plane word.
+template<typename T>
+void Detector::prewitt_sweep_region(const T *input_matrix, int width, pixel_grid grid, threshold_sweep *sweep) {
+    trace_span span("prewitt_sweep");
+    counter_region counters("prewitt_sweep");
+    int halo = (this->filter_size - 1) / 2;
+    size_t size = (size_t)tile_stride<T>(this->tile, halo) * (this->tile.height + 2 * halo);
+    sweep_index index = make_sweep_index(*sweep);
+    sweep_counts counts(vector<long long>(index.order.size(), 0));
+    parallel_grid(grid, RANGE_ROWS, this->partitioner, grain_for(grid), this->affinity, [&](pixel_grid block) {
+        long long *local = counts.local().data();
+        tiled_for_each(input_matrix, width, halo, block, this->tile, [&](const T *in, int stride, pixel_grid g, pixel_grid tile) {
+            gradient *magnitude = (gradient *)tile_scratch(1, size * sizeof(gradient));
+            gradient_magnitude(in, magnitude, *this->filter, this->norm, stride, g);
+            sweep_gradient_block(index, magnitude + (size_t)g.start_h * stride + g.start_w, stride, tile, local);
         });
-        tg.run([&]() {
-                pixel_grid g;
-                g.start_w = grid.start_w + (grid.end_w - grid.start_w) / 2;
-                g.end_w = grid.end_w;
-                g.start_h = grid.start_h + (grid.end_h - grid.start_h) / 2;
-                g.end_h = grid.end_h;
-                parallel_edge_detection(input_matrix, output_matrix, g);
+    });
+    finish_sweep(index, counts, *sweep);
+}
+
+template<typename T>
+void Detector::edge_sweep(const T *input_matrix, threshold_sweep *sweep, pixel_grid grid) {
+    edge_sweep_region(input_matrix, this->image_width, grid, sweep);
+}
+
+template<typename T>
+void Detector::padded_edge_sweep(const Image<T> &source, threshold_sweep *sweep) {
+    if(!halo_fits(source.get_halo(), (this->area - 1) / 2)) return;
+    edge_sweep_region(source.origin(), source.get_stride(), source.grid(), sweep);
+}
+
+// Window max and min do not depend on the threshold: each tile's are
+// computed once and swept for every threshold, as for the gradient.
+template<typename T>
+void Detector::edge_sweep_region(const T *input_matrix, int width, pixel_grid grid, threshold_sweep *sweep) {
+    trace_span span("edge_sweep");
+    counter_region counters("edge_sweep");
+    int halo = (this->area - 1) / 2;
+    size_t size = (size_t)tile_stride<T>(this->tile, halo) * (this->tile.height + 2 * halo);
+    sweep_index index = make_sweep_index(*sweep);
+    sweep_counts counts(vector<long long>(index.order.size(), 0));
+    parallel_grid(grid, RANGE_ROWS, this->partitioner, grain_for(grid), this->affinity, [&](pixel_grid block) {
+        long long *local = counts.local().data();
+        tiled_for_each(input_matrix, width, halo, block, this->tile, [&](const T *in, int stride, pixel_grid g, pixel_grid tile) {
+            T *max_matrix = (T *)tile_scratch(1, size * sizeof(T));
+            T *min_matrix = (T *)tile_scratch(2, size * sizeof(T));
+            running_minmax(in, max_matrix, min_matrix, stride, this->area, g);
+            size_t offset = (size_t)g.start_h * stride + g.start_w;
+            sweep_window_block(index, max_matrix + offset, min_matrix + offset, stride, tile, local);
         });
-        tg.wait();
-    }
+    });
+    finish_sweep(index, counts, *sweep);
+}
+
+// Padded by the border mode with the halo of the current filter and window,
+// enough for every padded_* run; pad once and reuse it across runs.
+template<typename T>
+Image<T> Detector::pad(const T *input_matrix) {
+    trace_span span("pad");
+    Image<T> padded(this->image_width, this->image_height, max((this->filter_size - 1) / 2, (this->area - 1) / 2));
+    padded.load(input_matrix);
+    padded.fill_border(this->border, (T)this->border_value);
+    return padded;
+}
+
+bool Detector::halo_fits(int halo, int needed) const {
+    if(halo >= needed) return true;
+    cout << "ERROR: padded input has a halo of " << halo << ", " << needed << " needed!" << endl;
+    return false;
+}
+
+// 0 is the default: the grain follows the size of each grid being split.
+long long Detector::grain_for(pixel_grid grid) const {
+    return this->grain > 0 ? this->grain : default_grain(grid);
+}
+
+bool Detector::tiled_for(pixel_grid grid, size_t element) const {
+    return this->tiled == TILING_AUTO ? exceeds_cache(grid, element) : this->tiled == TILING_ON;
+}
+
+long long Detector::get_grain() const {
+    return grain_for({0, this->image_width, 0, this->image_height});
+}
+
+kernel_variant Detector::get_prewitt_variant() const {
+    return this->prewitt_variant;
+}
+
+kernel_variant Detector::get_edge_variant() const {
+    return this->edge_variant;
 }
 
 void Detector::set_area(int area) {
@@ -231,18 +575,110 @@ void Detector::set_image_width(int width) {
 }
 
 
-void Detector::set_cutoff(int cutoff) {
-    this->cutoff = cutoff; 
+void Detector::set_grain(long long grain) {
+    this->grain = grain;
+}
+
+void Detector::set_range(range_kind range) {
+    this->range = range;
+}
+
+void Detector::set_partitioner(partitioner_kind partitioner) {
+    this->partitioner = partitioner;
+}
+
+void Detector::set_border(border_mode border, int value) {
+    this->border = border;
+    this->border_value = value;
+}
+
+void Detector::set_tiled(bool tiled) {
+    this->tiled = tiled ? TILING_ON : TILING_OFF;
+}
+
+void Detector::set_tile_shape(tile_shape tile) {
+    this->tile = tile;
+}
+
+void Detector::set_canny(canny_params canny) {
+    if(canny.sigma <= 0 || canny.low > canny.high) {
+        cout << "ERROR: Canny needs sigma > 0 and low <= high!" << endl;
+        return;
+    }
+    this->canny = canny;
+}
+
+void Detector::set_magnitude_norm(magnitude_norm norm) {
+    this->norm = norm;
 }
 
 void Detector::set_filter_size(int filter_size) {
-    this->filter_size = filter_size;
-    if(filter_size == 3) {
-        this->filter_h = PREWITT_H_3x3;
-        this->filter_v = PREWITT_V_3x3;
+    if(filter_size == 3) set_filter("prewitt3");
+    else if(filter_size == 5) set_filter("prewitt5");
+    else cout << "ERROR: Prewitt filter size must be 3 or 5!" << endl;
+}
+
+// Picks a registered filter and the kernel variant its properties favour.
+bool Detector::set_filter(const string &name) {
+    const gradient_filter *filter = find_filter(name);
+    if(filter == nullptr) {
+        cout << "ERROR: unknown filter " << name << "!" << endl;
+        return false;
     }
-    if(filter_size == 5) {
-        this->filter_h = PREWITT_H_5x5;
-        this->filter_v = PREWITT_V_5x5;
+    this->filter = filter;
+    this->filter_size = filter->size;
+    this->filter_h = filter->compass ? nullptr : filter->kernels[0].data();
+    this->filter_v = filter->compass ? nullptr : filter->kernels[1].data();
+    this->prewitt_kernels = filter->unrolled;
+    this->separable_h.valid = false;
+    this->separable_v.valid = false;
+    if(!filter->compass) {
+        this->separable_h = filter->separable[0];
+        this->separable_v = filter->separable[1];
     }
+    this->prewitt_variant = filter->preferred;
+    return true;
+}
+
+void Detector::set_prewitt_variant(kernel_variant variant) {
+    this->prewitt_variant = variant;
 }
+
+void Detector::set_edge_variant(kernel_variant variant) {
+    this->edge_variant = variant;
+}
+
+template void Detector::serial_prewitt<int>(const int *, int *, pixel_grid);
+template void Detector::serial_prewitt<pixel>(const pixel *, pixel *, pixel_grid);
+template void Detector::parallel_prewitt<int>(const int *, int *, pixel_grid);
+template void Detector::parallel_prewitt<pixel>(const pixel *, pixel *, pixel_grid);
+template void Detector::serial_edge_detection<int>(const int *, int *, pixel_grid);
+template void Detector::serial_edge_detection<pixel>(const pixel *, pixel *, pixel_grid);
+template void Detector::parallel_edge_detection<int>(const int *, int *, pixel_grid);
+template void Detector::parallel_edge_detection<pixel>(const pixel *, pixel *, pixel_grid);
+template void Detector::fused_detection<int>(const int *, int *, int *, vector<tile_stats> *, pixel_grid);
+template void Detector::fused_detection<pixel>(const pixel *, pixel *, pixel *, vector<tile_stats> *, pixel_grid);
+template void Detector::padded_prewitt<int>(const Image<int> &, int *, bool);
+template void Detector::padded_prewitt<pixel>(const Image<pixel> &, pixel *, bool);
+template void Detector::padded_edge_detection<int>(const Image<int> &, int *, bool);
+template void Detector::padded_edge_detection<pixel>(const Image<pixel> &, pixel *, bool);
+template void Detector::padded_fused_detection<int>(const Image<int> &, int *, int *, vector<tile_stats> *);
+template void Detector::padded_fused_detection<pixel>(const Image<pixel> &, pixel *, pixel *, vector<tile_stats> *);
+template Image<int> Detector::pad<int>(const int *);
+template Image<pixel> Detector::pad<pixel>(const pixel *);
+template void Detector::canny_detection<int>(const int *, int *);
+template void Detector::canny_detection<pixel>(const pixel *, pixel *);
+template void Detector::prewitt_magnitude<int>(const int *, gradient *, pixel_grid);
+template void Detector::prewitt_magnitude<pixel>(const pixel *, gradient *, pixel_grid);
+template void Detector::padded_prewitt_magnitude<int>(const Image<int> &, gradient *);
+template void Detector::padded_prewitt_magnitude<pixel>(const Image<pixel> &, gradient *);
+template void Detector::threshold_magnitude<int>(const gradient *, int *, int);
+template void Detector::threshold_magnitude<pixel>(const gradient *, pixel *, int);
+template void Detector::prewitt_sweep<int>(const int *, threshold_sweep *, pixel_grid);
+template void Detector::prewitt_sweep<pixel>(const pixel *, threshold_sweep *, pixel_grid);
+template void Detector::padded_prewitt_sweep<int>(const Image<int> &, threshold_sweep *);
+template void Detector::padded_prewitt_sweep<pixel>(const Image<pixel> &, threshold_sweep *);
+template void Detector::edge_sweep<int>(const int *, threshold_sweep *, pixel_grid);
+template void Detector::edge_sweep<pixel>(const pixel *, threshold_sweep *, pixel_grid);
+template void Detector::padded_edge_sweep<int>(const Image<int> &, threshold_sweep *);
+template void Detector::padded_edge_sweep<pixel>(const Image<pixel> &, threshold_sweep *);
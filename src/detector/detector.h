@@ -1,71 +1,145 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <tuple>
 #include <tbb/task_group.h>
 #include "../bitmap/EasyBMP.h"
 #include "../bitmap/BitmapRawConverter.h"
+#include "kernels.h"
+#include "separable.h"
+#include "filters.h"
+#include "decomposition.h"
+#include "tiling.h"
+#include "image.h"
+#include "canny.h"
+#include "sweep.h"
+#include "tuning.h"
 
 #pragma once
 
-const int THRESHOLD = 128;
-
-const int PREWITT_H_3x3[] = {-1, 0, 1, -1, 0, 1, -1, 0, 1};
-
-const int PREWITT_V_3x3[] = {-1, -1, -1, 0, 0, 0, 1, 1, 1};
-
-const int PREWITT_H_5x5[] = {9 , 9,  9,  9,  9,
-                             9,  5,  5,  5,  9,
-                            -7, -3,  0, -3, -7,
-                            -7, -3, -3, -3, -7,
-                            -7, -7, -7, -7, -7};
-
-const int PREWITT_V_5x5[] = {9, 9, -7, -7, -7,
-                             9, 5, -3, -3, -7,
-                             9, 5,  0,  -3, -7,
-                             9, 5, -3, -3, -7,
-                             9, 9, -7, -7, -7};
-
-struct pixel_grid{
-    int start_w;
-    int end_w;
-    int start_h;
-    int end_h;
+struct tile_stats {
+    pixel_grid tile;
+    int min;
+    int max;
+    long long sum;
+    long long sum_squares;
 };
 
-int prewitt_convolve(int *, const int *, const int *, int, int, int, int);
-int edge_detection_p_and_o(int *, int, int, int, int);
-
 class Detector {
     private:
         int image_width;
         int image_height;
 
+        const gradient_filter *filter;
         int const *filter_h;
         int const *filter_v;
         int filter_size;
+        std::tuple<prewitt_fixed_fn<int>, prewitt_fixed_fn<pixel>> prewitt_kernels;
+        separable_filter separable_h;
+        separable_filter separable_v;
 
         int area;
-        int cutoff;
-
-    void edge_detection_helper(int *, int *, int, int, int);
-    void prewitt_helper(int *, int *, int, int, int);
+        long long grain;
+        range_kind range;
+        partitioner_kind partitioner;
+        tbb::affinity_partitioner affinity;
+
+        kernel_variant prewitt_variant;
+        kernel_variant edge_variant;
+
+        tiling_mode tiled;
+        tile_shape tile;
+
+        border_mode border;
+        int border_value;
+
+        canny_params canny;
+        magnitude_norm norm;
+
+        tuning_profile tuning;
+
+    template<typename T>
+    void edge_detection_helper(const T *, T *, int, pixel_grid);
+    template<typename T>
+    void prewitt_helper(const T *, T *, int, pixel_grid);
+    template<typename T>
+    void prewitt_region(const T *, T *, int, pixel_grid, bool);
+    template<typename T>
+    void edge_detection_region(const T *, T *, int, pixel_grid, bool);
+    template<typename T>
+    void fused_region(const T *, T *, T *, int, std::vector<tile_stats> *, pixel_grid);
+    template<typename T>
+    void magnitude_region(const T *, gradient *, int, pixel_grid);
+    template<typename T>
+    void prewitt_sweep_region(const T *, int, pixel_grid, threshold_sweep *);
+    template<typename T>
+    void edge_sweep_region(const T *, int, pixel_grid, threshold_sweep *);
+    long long grain_for(pixel_grid) const;
+    bool halo_fits(int, int) const;
+    bool tiled_for(pixel_grid, size_t) const;
 
     public:
         Detector();
         ~Detector() {};
 
-        void serial_prewitt(int *, int *, pixel_grid);
-        void parallel_prewitt(int *, int *, pixel_grid);
-        void serial_edge_detection(int *, int *, pixel_grid);
-        void parallel_edge_detection(int *, int *, pixel_grid);
+        template<typename T>
+        void serial_prewitt(const T *, T *, pixel_grid);
+        template<typename T>
+        void parallel_prewitt(const T *, T *, pixel_grid);
+        template<typename T>
+        void serial_edge_detection(const T *, T *, pixel_grid);
+        template<typename T>
+        void parallel_edge_detection(const T *, T *, pixel_grid);
+        template<typename T>
+        void fused_detection(const T *, T *, T *, std::vector<tile_stats> *, pixel_grid);
+        template<typename T>
+        void padded_prewitt(const Image<T> &, T *, bool);
+        template<typename T>
+        void padded_edge_detection(const Image<T> &, T *, bool);
+        template<typename T>
+        void padded_fused_detection(const Image<T> &, T *, T *, std::vector<tile_stats> *);
+        template<typename T>
+        void canny_detection(const T *, T *);
+        template<typename T>
+        void prewitt_magnitude(const T *, gradient *, pixel_grid);
+        template<typename T>
+        void padded_prewitt_magnitude(const Image<T> &, gradient *);
+        template<typename T>
+        void threshold_magnitude(const gradient *, T *, int);
+        template<typename T>
+        void prewitt_sweep(const T *, threshold_sweep *, pixel_grid);
+        template<typename T>
+        void padded_prewitt_sweep(const Image<T> &, threshold_sweep *);
+        template<typename T>
+        void edge_sweep(const T *, threshold_sweep *, pixel_grid);
+        template<typename T>
+        void padded_edge_sweep(const Image<T> &, threshold_sweep *);
+
+        template<typename T>
+        Image<T> pad(const T *);
 
         void start_detector();
-        void run_test_nr(int, BitmapRawConverter*, char*, int*, pixel_grid);
+        const tuning_entry *apply_tuning();
+        void run_test_nr(int, const pixel*, const Image<pixel> &, BitmapRawConverter*, char*, pixel*, pixel_grid);
+
+        long long get_grain() const;
+        kernel_variant get_prewitt_variant() const;
+        kernel_variant get_edge_variant() const;
 
         void set_area(int);
-        void set_cutoff(int);
+        void set_grain(long long);
+        void set_range(range_kind);
+        void set_partitioner(partitioner_kind);
+        void set_border(border_mode, int);
+        void set_tiled(bool);
+        void set_tile_shape(tile_shape);
+        void set_canny(canny_params);
+        void set_magnitude_norm(magnitude_norm);
         void set_image_width(int);
         void set_image_height(int);
         void set_detector(int);
         void set_filter_size(int);
+        bool set_filter(const std::string &);
+        void set_prewitt_variant(kernel_variant);
+        void set_edge_variant(kernel_variant);
 };
@@ -0,0 +1,231 @@
+#include "filters.h"
+#include "prewitt_fixed.h"
+#include "simd.h"
+#include <iostream>
+#include <map>
+#include <cmath>
+#include <type_traits>
+
+using namespace std;
+
+static const int KIRSCH_N_3x3[] = {5, 5, 5, -3, 0, -3, -3, -3, -3};
+
+static const int ROBINSON_N_3x3[] = {1, 2, 1, 0, 0, 0, -1, -2, -1};
+
+static map<string, gradient_filter> &registry();
+
+// Outer ring of a 3x3 kernel, clockwise from the top left corner.
+static const int RING[] = {0, 1, 2, 5, 8, 7, 6, 3};
+
+static vector<vector<int>> compass_set(const int *north) {
+    vector<vector<int>> kernels;
+    vector<int> kernel(north, north + 9);
+    for(int d = 0; d < 8; ++d) {
+        kernels.push_back(kernel);
+        vector<int> rotated = kernel;
+        for(int k = 0; k < 8; ++k) rotated[RING[(k + 1) % 8]] = kernel[RING[k]];
+        kernel = rotated;
+    }
+    return kernels;
+}
+
+// Separable wins when its taps are a quarter of the direct window or less;
+// below that the vector kernel, which does 4-16 pixels per tap, is faster.
+static kernel_variant preferred_variant(const gradient_filter &filter) {
+    if(filter.compass) return KERNEL_COMPASS;
+    if(filter.separable_cost > 0 && filter.separable_cost * 4 <= filter.direct_cost) return KERNEL_SEPARABLE;
+    if(simd_active_isa() != ISA_SCALAR) return KERNEL_SIMD;
+    if(get<prewitt_fixed_fn<int>>(filter.unrolled) != nullptr) return KERNEL_UNROLLED;
+    // the narrow kernels' scalar loop still skips zero taps and pairs mirrored ones
+    if(filter.fits_int16) return KERNEL_SIMD;
+    return KERNEL_SCALAR;
+}
+
+static void register_builtins(map<string, gradient_filter> &filters) {
+    auto add = [&](const string &name, int size, const int *h, const int *v, tuple<prewitt_fixed_fn<int>, prewitt_fixed_fn<pixel>> unrolled) {
+        register_filter(name, size, {vector<int>(h, h + size * size), vector<int>(v, v + size * size)}, false);
+        filters[name].unrolled = unrolled;
+        filters[name].preferred = preferred_variant(filters[name]);
+    };
+    add("prewitt3", 3, PREWITT_H_3x3, PREWITT_V_3x3,
+        {prewitt_fixed<3, PREWITT_H_3x3, PREWITT_V_3x3, int>, prewitt_fixed<3, PREWITT_H_3x3, PREWITT_V_3x3, pixel>});
+    add("prewitt5", 5, PREWITT_H_5x5, PREWITT_V_5x5,
+        {prewitt_fixed<5, PREWITT_H_5x5, PREWITT_V_5x5, int>, prewitt_fixed<5, PREWITT_H_5x5, PREWITT_V_5x5, pixel>});
+    add("sobel3", 3, SOBEL_H_3x3, SOBEL_V_3x3,
+        {prewitt_fixed<3, SOBEL_H_3x3, SOBEL_V_3x3, int>, prewitt_fixed<3, SOBEL_H_3x3, SOBEL_V_3x3, pixel>});
+    add("scharr3", 3, SCHARR_H_3x3, SCHARR_V_3x3,
+        {prewitt_fixed<3, SCHARR_H_3x3, SCHARR_V_3x3, int>, prewitt_fixed<3, SCHARR_H_3x3, SCHARR_V_3x3, pixel>});
+    register_filter("kirsch", 3, compass_set(KIRSCH_N_3x3), true);
+    register_filter("robinson", 3, compass_set(ROBINSON_N_3x3), true);
+}
+
+static map<string, gradient_filter> &registry() {
+    static map<string, gradient_filter> filters;
+    static bool initialized = false;
+    if(!initialized) {
+        initialized = true;
+        register_builtins(filters);
+    }
+    return filters;
+}
+
+// Entries are never replaced: Detectors keep pointers into them.
+const gradient_filter *register_filter(const string &name, int size, const vector<vector<int>> &kernels, bool compass) {
+    map<string, gradient_filter> &filters = registry();
+    if(filters.count(name) != 0) {
+        cout << "ERROR: filter " << name << " is already registered!" << endl;
+        return nullptr;
+    }
+    if(size < 1 || size % 2 == 0 || (!compass && kernels.size() != 2) || kernels.empty()) {
+        cout << "ERROR: filter " << name << " must have an odd size and a kernel pair or a compass set!" << endl;
+        return nullptr;
+    }
+    for(const vector<int> &kernel : kernels) {
+        if((int)kernel.size() != size * size) {
+            cout << "ERROR: filter " << name << " needs " << size * size << " taps per kernel!" << endl;
+            return nullptr;
+        }
+    }
+
+    gradient_filter filter;
+    filter.name = name;
+    filter.size = size;
+    filter.compass = compass;
+    filter.kernels = kernels;
+    filter.unrolled = {nullptr, nullptr};
+    filter.separable_cost = 0;
+    filter.direct_cost = 0;
+    filter.antisymmetric = true;
+
+    int taps = size * size;
+    long long max_sum = 0;
+    for(const vector<int> &kernel : kernels) {
+        long long sum = 0;
+        for(int k = 0; k < taps; ++k) {
+            sum += abs(kernel[k]);
+            filter.direct_cost += kernel[k] != 0;
+            filter.antisymmetric = filter.antisymmetric && kernel[k] == -kernel[taps - 1 - k];
+        }
+        max_sum = max(max_sum, 255 * sum);
+    }
+    // partial sums, and the paired differences, never exceed the full one
+    filter.fits_int16 = max_sum <= 32767;
+
+    if(!compass) {
+        int offset = (size - 1) / 2;
+        for(int k = 0; k < (filter.antisymmetric ? taps / 2 : taps); ++k) {
+            if(kernels[0][k] == 0 && kernels[1][k] == 0) continue;
+            filter.taps.push_back({k / size - offset, k % size - offset, kernels[0][k], kernels[1][k]});
+        }
+        for(const vector<int> &kernel : kernels) {
+            filter.separable.push_back(separable_factor(kernel.data(), size));
+            if(!filter.separable.back().valid) filter.separable_cost = -1;
+            else if(filter.separable_cost >= 0) filter.separable_cost += filter.separable.back().cost;
+        }
+    }
+    filter.preferred = preferred_variant(filter);
+
+    filters[name] = filter;
+    return &filters[name];
+}
+
+const gradient_filter *find_filter(const string &name) {
+    map<string, gradient_filter> &filters = registry();
+    auto it = filters.find(name);
+    return it == filters.end() ? nullptr : &it->second;
+}
+
+vector<string> filter_names() {
+    vector<string> names;
+    for(const auto &entry : registry()) names.push_back(entry.first);
+    return names;
+}
+
+// All directions from one pass over the window: every pixel is loaded once and
+// added into each direction's sum. Taps that are zero in every direction are
+// dropped up front. The response is the largest signed Gd, as for the usual
+// Kirsch and Robinson operators: an edge counts for the direction it faces,
+// not for the opposite one. It is never below 0.
+template<bool Magnitude, typename T, typename O>
+static void compass_pass(const T *input_matrix, O *output_matrix, const gradient_filter &filter, int width, pixel_grid grid) {
+    int n = filter.size, offset = (n - 1) / 2;
+    int directions = filter.kernels.size();
+    vector<int> positions, coefficients;
+    for(int k = 0; k < n * n; ++k) {
+        bool zero = true;
+        for(int d = 0; d < directions; ++d) zero = zero && filter.kernels[d][k] == 0;
+        if(zero) continue;
+        positions.push_back((k / n - offset) * width + (k % n - offset));
+        for(int d = 0; d < directions; ++d) coefficients.push_back(filter.kernels[d][k]);
+    }
+    vector<int> sums(directions);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        for(int j = grid.start_w; j < grid.end_w; ++j) {
+            const T *center = input_matrix + i * width + j;
+            fill(sums.begin(), sums.end(), 0);
+            const int *c = coefficients.data();
+            for(size_t t = 0; t < positions.size(); ++t, c += directions) {
+                int value = center[positions[t]];
+                for(int d = 0; d < directions; ++d) sums[d] += c[d] * value;
+            }
+            int strongest = 0;
+            for(int d = 0; d < directions; ++d) strongest = max(strongest, sums[d]);
+            if constexpr(Magnitude) output_matrix[i * width + j] = min(strongest, 65535);
+            else output_matrix[i * width + j] = strongest > THRESHOLD ? 255 : 0;
+        }
+    }
+}
+
+template<typename T>
+void compass_gradient(const T *input_matrix, T *output_matrix, const gradient_filter &filter, int width, pixel_grid grid) {
+    compass_pass<false>(input_matrix, output_matrix, filter, width, grid);
+}
+
+static inline int integer_hypot(long long h, long long v) {
+    long long squares = h * h + v * v;
+    long long root = (long long)sqrt((double)squares);
+    while(root * root > squares) --root;
+    while((root + 1) * (root + 1) <= squares) ++root;
+    return (int)min(root, 65535LL);
+}
+
+// The gradient before any threshold, saturated to 16 bits: L1 is what the
+// binary kernels compare against THRESHOLD, L2 is floor(sqrt(Gh^2 + Gv^2)).
+// Compass filters always give the largest signed Gd.
+template<typename T>
+void gradient_magnitude(const T *input_matrix, gradient *output_matrix, const gradient_filter &filter, magnitude_norm norm, int width, pixel_grid grid) {
+    if(filter.compass) {
+        compass_pass<true>(input_matrix, output_matrix, filter, width, grid);
+        return;
+    }
+    const int *filter_h = filter.kernels[0].data(), *filter_v = filter.kernels[1].data();
+    if(norm == NORM_L1) {
+        if constexpr(is_same_v<T, pixel>) {
+            if(filter.fits_int16) {
+                simd_gradient_narrow(input_matrix, output_matrix, filter.taps.data(), filter.taps.size(), filter.antisymmetric, width, grid);
+                return;
+            }
+        }
+        simd_gradient(input_matrix, output_matrix, filter_h, filter_v, width, filter.size, grid);
+        return;
+    }
+    int n = filter.size, offset = (n - 1) / 2;
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        for(int j = grid.start_w; j < grid.end_w; ++j) {
+            int horizontal_sum = 0, vertical_sum = 0;
+            for(int a = 0; a < n; ++a) {
+                const T *row = input_matrix + (i - offset + a) * width + (j - offset);
+                for(int b = 0; b < n; ++b) {
+                    horizontal_sum += filter_h[a * n + b] * row[b];
+                    vertical_sum += filter_v[a * n + b] * row[b];
+                }
+            }
+            output_matrix[i * width + j] = integer_hypot(horizontal_sum, vertical_sum);
+        }
+    }
+}
+
+template void compass_gradient<int>(const int *, int *, const gradient_filter &, int, pixel_grid);
+template void compass_gradient<pixel>(const pixel *, pixel *, const gradient_filter &, int, pixel_grid);
+template void gradient_magnitude<int>(const int *, gradient *, const gradient_filter &, magnitude_norm, int, pixel_grid);
+template void gradient_magnitude<pixel>(const pixel *, gradient *, const gradient_filter &, magnitude_norm, int, pixel_grid);
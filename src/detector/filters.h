@@ -0,0 +1,41 @@
+#include <string>
+#include <tuple>
+#include <vector>
+#include "kernels.h"
+#include "separable.h"
+
+#pragma once
+
+// A named gradient operator: either a horizontal/vertical pair combined as
+// |Gh| + |Gv|, or a compass set combined as the largest signed Gd. The properties
+// below are worked out once at registration and decide which kernel runs.
+// taps lists a pair's taps that are nonzero in either kernel; when the pair
+// is antisymmetric only the first half is kept, each tap then standing for
+// the pixel minus its mirror. fits_int16 means every sum over 8-bit input
+// fits int16 lanes.
+struct gradient_filter {
+    std::string name;
+    int size;
+    bool compass;
+    std::vector<std::vector<int>> kernels;
+
+    std::vector<separable_filter> separable;
+    int separable_cost;
+    int direct_cost;
+    std::vector<filter_tap> taps;
+    bool antisymmetric;
+    bool fits_int16;
+    std::tuple<prewitt_fixed_fn<int>, prewitt_fixed_fn<pixel>> unrolled;
+    kernel_variant preferred;
+};
+
+enum magnitude_norm { NORM_L1, NORM_L2 };
+
+const gradient_filter *register_filter(const std::string &, int, const std::vector<std::vector<int>> &, bool);
+const gradient_filter *find_filter(const std::string &);
+std::vector<std::string> filter_names();
+
+template<typename T>
+void compass_gradient(const T *, T *, const gradient_filter &, int, pixel_grid);
+template<typename T>
+void gradient_magnitude(const T *, gradient *, const gradient_filter &, magnitude_norm, int, pixel_grid);
@@ -0,0 +1,10 @@
+#pragma once
+
+// A rectangle of the image, end exclusive. Kept apart from kernels.h so that
+// code outside the detector (tracing) can name a block without the kernels.
+struct pixel_grid{
+    int start_w;
+    int end_w;
+    int start_h;
+    int end_h;
+};
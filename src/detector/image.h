@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/cache_aligned_allocator.h>
+#include "kernels.h"
+
+#pragma once
+
+// BORDER_NONE keeps the old behaviour: no padding, the frame a window cannot
+// cover is left untouched. The other modes define the pixels outside the image
+// (reflect-101 mirrors without repeating the edge pixel: ... c b | a b c | b a ...).
+enum border_mode { BORDER_NONE, BORDER_REPLICATE, BORDER_REFLECT_101, BORDER_CONSTANT };
+
+// What start_detector runs with, and so what autotune measures.
+constexpr border_mode DETECTOR_BORDER = BORDER_REPLICATE;
+
+inline int border_index(int x, int size, border_mode mode) {
+    if(mode == BORDER_REPLICATE || size == 1) return std::min(std::max(x, 0), size - 1);
+    while(x < 0 || x >= size) {
+        if(x < 0) x = -x;
+        if(x >= size) x = 2 * size - 2 - x;
+    }
+    return x;
+}
+
+// Image with a halo of pixels on every side. Rows are stride apart and (0, 0)
+// is at origin(), so a kernel can read up to halo pixels outside the image
+// without any bounds checks.
+template<typename T>
+class Image {
+    private:
+        int width;
+        int height;
+        int halo;
+        int stride;
+        std::vector<T, tbb::cache_aligned_allocator<T>> data;
+
+    public:
+        Image(int width, int height, int halo)
+            : width(width), height(height), halo(halo), stride(width + 2 * halo), data((size_t)(width + 2 * halo) * (height + 2 * halo), 0) {}
+
+        int get_width() const { return width; }
+        int get_height() const { return height; }
+        int get_halo() const { return halo; }
+        int get_stride() const { return stride; }
+
+        T *origin() { return data.data() + (size_t)halo * stride + halo; }
+        const T *origin() const { return data.data() + (size_t)halo * stride + halo; }
+        T *row(int y) { return origin() + (ptrdiff_t)y * stride; }
+        const T *row(int y) const { return origin() + (ptrdiff_t)y * stride; }
+        pixel_grid grid() const { return pixel_grid{0, width, 0, height}; }
+
+        void load(const T *pixels) {
+            tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int> &r) {
+                for(int y = r.begin(); y < r.end(); ++y) memcpy(row(y), pixels + (size_t)y * width, width * sizeof(T));
+            });
+        }
+
+        void store(T *pixels) const {
+            tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int> &r) {
+                for(int y = r.begin(); y < r.end(); ++y) memcpy(pixels + (size_t)y * width, row(y), width * sizeof(T));
+            });
+        }
+
+        // Left and right halo of every image row first, then whole halo rows
+        // are copied from the rows they map to.
+        void fill_border(border_mode mode, T value) {
+            if(halo == 0 || mode == BORDER_NONE) return;
+            tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int> &r) {
+                for(int y = r.begin(); y < r.end(); ++y) {
+                    T *line = row(y);
+                    for(int x = 1; x <= halo; ++x) {
+                        line[-x] = mode == BORDER_CONSTANT ? value : line[border_index(-x, width, mode)];
+                        line[width - 1 + x] = mode == BORDER_CONSTANT ? value : line[border_index(width - 1 + x, width, mode)];
+                    }
+                }
+            });
+            tbb::parallel_for(tbb::blocked_range<int>(1, halo + 1), [&](const tbb::blocked_range<int> &r) {
+                for(int d = r.begin(); d < r.end(); ++d) {
+                    T *above = row(-d) - halo, *below = row(height - 1 + d) - halo;
+                    if(mode == BORDER_CONSTANT) {
+                        std::fill(above, above + stride, value);
+                        std::fill(below, below + stride, value);
+                        continue;
+                    }
+                    memcpy(above, row(border_index(-d, height, mode)) - halo, stride * sizeof(T));
+                    memcpy(below, row(border_index(height - 1 + d, height, mode)) - halo, stride * sizeof(T));
+                }
+            });
+        }
+};
@@ -0,0 +1,81 @@
+#include <cstdint>
+#include <cstdlib>
+#include "grid.h"
+
+#pragma once
+
+constexpr int THRESHOLD = 128;
+
+constexpr int PREWITT_H_3x3[] = {-1, 0, 1, -1, 0, 1, -1, 0, 1};
+
+constexpr int PREWITT_V_3x3[] = {-1, -1, -1, 0, 0, 0, 1, 1, 1};
+
+constexpr int PREWITT_H_5x5[] = {9 , 9,  9,  9,  9,
+                                 9,  5,  5,  5,  9,
+                                -7, -3,  0, -3, -7,
+                                -7, -3, -3, -3, -7,
+                                -7, -7, -7, -7, -7};
+
+constexpr int PREWITT_V_5x5[] = {9, 9, -7, -7, -7,
+                                 9, 5, -3, -3, -7,
+                                 9, 5,  0,  -3, -7,
+                                 9, 5, -3, -3, -7,
+                                 9, 9, -7, -7, -7};
+
+constexpr int SOBEL_H_3x3[] = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
+
+constexpr int SOBEL_V_3x3[] = {-1, -2, -1, 0, 0, 0, 1, 2, 1};
+
+constexpr int SCHARR_H_3x3[] = {-3, 0, 3, -10, 0, 10, -3, 0, 3};
+
+constexpr int SCHARR_V_3x3[] = {-3, -10, -3, 0, 0, 0, 3, 10, 3};
+
+// One tap of a kernel pair, dy rows and dx columns from the window centre.
+struct filter_tap {
+    int dy;
+    int dx;
+    int h;
+    int v;
+};
+
+enum kernel_variant { KERNEL_SCALAR, KERNEL_SIMD, KERNEL_UNROLLED, KERNEL_SEPARABLE, KERNEL_RUNNING, KERNEL_BITPLANE, KERNEL_COMPASS };
+
+// Images are stored as uint8_t; every kernel is also instantiated for int so
+// callers holding int buffers can use it directly. Sums are always int.
+typedef uint8_t pixel;
+// Gradient strength before thresholding, saturated at 65535.
+typedef uint16_t gradient;
+
+template<typename T>
+using prewitt_fixed_fn = void (*)(const T *, T *, int, pixel_grid);
+
+template<typename T>
+int prewitt_gradient(const T *input_matrix, const int *filter_h, const int *filter_v, int x, int y, int picture_size, int filter_size) {
+    int picture_offset = (filter_size - 1) / 2;
+    int vertical_sum = 0, horizontal_sum = 0;
+    for(int i = 0; i < filter_size; ++i) {
+        for(int j = 0; j < filter_size; ++j) {
+            vertical_sum += filter_v[i * filter_size + j] * input_matrix[(x - picture_offset + i) * picture_size + (y - picture_offset + j)];
+            horizontal_sum += filter_h[i * filter_size +j] * input_matrix[(x - picture_offset + i) * picture_size + (y - picture_offset + j)];
+        }
+    }
+    return abs(horizontal_sum) + abs(vertical_sum);
+}
+
+template<typename T>
+int prewitt_convolve(const T *input_matrix, const int *filter_h, const int *filter_v, int x, int y, int picture_size, int filter_size) {
+    return prewitt_gradient(input_matrix, filter_h, filter_v, x, y, picture_size, filter_size) > THRESHOLD ? 255 : 0;
+}
+
+template<typename T>
+int edge_detection_p_and_o(const T *input_matrix, int width, int x, int y, int filter_size){
+    int p = 0, o = 1;
+    int picture_offset = (filter_size - 1) / 2;
+    for(int i =0; i < filter_size; i++) {
+        for(int j = 0; j < filter_size; j++) {
+            if(input_matrix[(x - picture_offset + i) * width + (y - picture_offset + j)] >= THRESHOLD) p = 1;
+            if(input_matrix[(x - picture_offset + i) * width + (y - picture_offset + j)] < THRESHOLD) o = 0;
+        }
+    }
+    return abs(p-o) == 1 ? 255: 0;
+}
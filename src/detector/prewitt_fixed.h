@@ -0,0 +1,42 @@
+#include <utility>
+#include "kernels.h"
+
+#pragma once
+
+// Prewitt kernels specialized on the filter at compile time. The N*N window is
+// unrolled through an index_sequence, taps that are zero in both filters are
+// never loaded, and every remaining pixel is read once and fed to both sums.
+
+template<int N, const int *H, const int *V, std::size_t K, typename T>
+inline void prewitt_tap(const T *window, int picture_size, int &horizontal_sum, int &vertical_sum) {
+    constexpr int h = H[K];
+    constexpr int v = V[K];
+    if constexpr (h != 0 || v != 0) {
+        int pixel = window[(K / N) * picture_size + K % N];
+        if constexpr (h != 0) horizontal_sum += h * pixel;
+        if constexpr (v != 0) vertical_sum += v * pixel;
+    }
+}
+
+template<int N, const int *H, const int *V, typename T, std::size_t... K>
+inline int prewitt_unrolled(const T *window, int picture_size, std::index_sequence<K...>) {
+    int horizontal_sum = 0, vertical_sum = 0;
+    (prewitt_tap<N, H, V, K>(window, picture_size, horizontal_sum, vertical_sum), ...);
+    return (abs(horizontal_sum) + abs(vertical_sum)) > THRESHOLD ? 255 : 0;
+}
+
+template<int N, const int *H, const int *V, typename T>
+inline int prewitt_convolve_fixed(const T *input_matrix, int x, int y, int picture_size) {
+    constexpr int picture_offset = (N - 1) / 2;
+    const T *window = input_matrix + (x - picture_offset) * picture_size + (y - picture_offset);
+    return prewitt_unrolled<N, H, V>(window, picture_size, std::make_index_sequence<N * N>{});
+}
+
+template<int N, const int *H, const int *V, typename T>
+void prewitt_fixed(const T *input_matrix, T *output_matrix, int width, pixel_grid grid) {
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        for(int j = grid.start_w; j < grid.end_w; ++j) {
+            output_matrix[i * width + j] = prewitt_convolve_fixed<N, H, V>(input_matrix, i, j, width);
+        }
+    }
+}
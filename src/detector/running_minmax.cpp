@@ -0,0 +1,127 @@
+#include "running_minmax.h"
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// van Herk/Gil-Werman running max/min. The line is cut into blocks of the window
+// size; a prefix pass (g) and a suffix pass (h) inside every block give the max
+// of any window as max(h[x], g[x + window - 1]), three compares per sample no
+// matter how large the window is. The 2D window is a horizontal pass per input
+// row followed by a vertical pass over whole rows, done in strips of output
+// rows so the scratch stays small.
+
+static const int STRIP_ROWS = 64;
+
+template<typename T>
+static void horizontal_minmax(const T *line, int length, int window, T *g_max, T *g_min, T *out_max, T *out_min) {
+    for(int x = 0; x < length; ++x) {
+        if(x % window == 0) {
+            g_max[x] = line[x];
+            g_min[x] = line[x];
+        }
+        else {
+            g_max[x] = max(g_max[x - 1], line[x]);
+            g_min[x] = min(g_min[x - 1], line[x]);
+        }
+    }
+    T h_max = line[length - 1], h_min = line[length - 1];
+    int count = length - window + 1;
+    for(int x = length - 1; x >= 0; --x) {
+        if(x % window == window - 1 || x == length - 1) {
+            h_max = line[x];
+            h_min = line[x];
+        }
+        else {
+            h_max = max(h_max, line[x]);
+            h_min = min(h_min, line[x]);
+        }
+        if(x < count) {
+            out_max[x] = max(h_max, g_max[x + window - 1]);
+            out_min[x] = min(h_min, g_min[x + window - 1]);
+        }
+    }
+}
+
+// Calls emit(i, row_max, row_min) for every output row of the grid.
+template<typename T, typename Emit>
+static void minmax_strips(const T *input, int width, int window, pixel_grid grid, Emit emit) {
+    int offset = (window - 1) / 2;
+    int count = grid.end_w - grid.start_w;
+    if(count <= 0 || grid.end_h <= grid.start_h) return;
+    int length = count + 2 * offset;
+    int strip = max(STRIP_ROWS, 2 * window);
+
+    vector<T> g_max(length), g_min(length);
+    vector<T> f_max((strip + 2 * offset) * count), f_min((strip + 2 * offset) * count);
+    vector<T> v_max((strip + 2 * offset) * count), v_min((strip + 2 * offset) * count);
+    vector<T> out_max(count), out_min(count);
+
+    for(int top = grid.start_h; top < grid.end_h; top += strip) {
+        int rows = min(strip, grid.end_h - top) + 2 * offset;
+        for(int r = 0; r < rows; ++r) {
+            const T *line = input + (top - offset + r) * width + grid.start_w - offset;
+            horizontal_minmax(line, length, window, g_max.data(), g_min.data(), &f_max[r * count], &f_min[r * count]);
+        }
+
+        // vertical prefix pass into v, suffix pass in place over f
+        for(int r = 0; r < rows; ++r) {
+            T *vm = &v_max[r * count], *vn = &v_min[r * count];
+            const T *fm = &f_max[r * count], *fn = &f_min[r * count];
+            if(r % window == 0) {
+                copy(fm, fm + count, vm);
+                copy(fn, fn + count, vn);
+                continue;
+            }
+            const T *pm = vm - count, *pn = vn - count;
+            for(int j = 0; j < count; ++j) {
+                vm[j] = max(pm[j], fm[j]);
+                vn[j] = min(pn[j], fn[j]);
+            }
+        }
+        for(int r = rows - 2; r >= 0; --r) {
+            if(r % window == window - 1) continue;
+            T *fm = &f_max[r * count], *fn = &f_min[r * count];
+            const T *nm = fm + count, *nn = fn + count;
+            for(int j = 0; j < count; ++j) {
+                fm[j] = max(fm[j], nm[j]);
+                fn[j] = min(fn[j], nn[j]);
+            }
+        }
+        for(int r = 0; r + window <= rows; ++r) {
+            const T *hm = &f_max[r * count], *hn = &f_min[r * count];
+            const T *gm = &v_max[(r + window - 1) * count], *gn = &v_min[(r + window - 1) * count];
+            for(int j = 0; j < count; ++j) {
+                out_max[j] = max(hm[j], gm[j]);
+                out_min[j] = min(hn[j], gn[j]);
+            }
+            emit(top + r, out_max.data(), out_min.data());
+        }
+    }
+}
+
+template<typename T>
+void running_minmax(const T *input_matrix, T *max_matrix, T *min_matrix, int width, int window, pixel_grid grid) {
+    int count = grid.end_w - grid.start_w;
+    minmax_strips(input_matrix, width, window, grid, [&](int i, const T *row_max, const T *row_min) {
+        copy(row_max, row_max + count, max_matrix + i * width + grid.start_w);
+        copy(row_min, row_min + count, min_matrix + i * width + grid.start_w);
+    });
+}
+
+// Same decision as edge_detection_p_and_o: some pixel reaches THRESHOLD and some does not.
+template<typename T>
+void running_edge_detection(const T *input_matrix, T *output_matrix, int width, int window, pixel_grid grid) {
+    int count = grid.end_w - grid.start_w;
+    minmax_strips(input_matrix, width, window, grid, [&](int i, const T *row_max, const T *row_min) {
+        T *out = output_matrix + i * width + grid.start_w;
+        for(int j = 0; j < count; ++j) {
+            out[j] = (row_max[j] >= THRESHOLD && row_min[j] < THRESHOLD) ? 255 : 0;
+        }
+    });
+}
+
+template void running_minmax<int>(const int *, int *, int *, int, int, pixel_grid);
+template void running_minmax<pixel>(const pixel *, pixel *, pixel *, int, int, pixel_grid);
+template void running_edge_detection<int>(const int *, int *, int, int, pixel_grid);
+template void running_edge_detection<pixel>(const pixel *, pixel *, int, int, pixel_grid);
@@ -0,0 +1,8 @@
+#include "kernels.h"
+
+#pragma once
+
+template<typename T>
+void running_minmax(const T *, T *, T *, int, int, pixel_grid);
+template<typename T>
+void running_edge_detection(const T *, T *, int, int, pixel_grid);
@@ -0,0 +1,254 @@
+#include "separable.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <numeric>
+
+using namespace std;
+
+// Filters are factored with a skeleton decomposition: with P independent rows
+// and Q pivot columns of a rank-r filter K, K = K[:,Q] * inverse(K[P][Q]) * K[P,:].
+// Using adj/det instead of the inverse keeps every term an integer vector, so
+// the sums stay bit-identical to prewitt_convolve.
+
+static long long determinant(vector<vector<long long>> m) {
+    // Bareiss fraction-free elimination, every division is exact.
+    int n = m.size();
+    if(n == 0) return 1;
+    long long sign = 1, previous = 1;
+    for(int k = 0; k < n - 1; ++k) {
+        if(m[k][k] == 0) {
+            int p = k + 1;
+            while(p < n && m[p][k] == 0) ++p;
+            if(p == n) return 0;
+            swap(m[k], m[p]);
+            sign = -sign;
+        }
+        for(int i = k + 1; i < n; ++i) {
+            for(int j = k + 1; j < n; ++j) {
+                m[i][j] = (m[i][j] * m[k][k] - m[i][k] * m[k][j]) / previous;
+            }
+        }
+        previous = m[k][k];
+    }
+    return sign * m[n - 1][n - 1];
+}
+
+static bool is_box(const vector<int> &taps) {
+    for(int tap : taps) {
+        if(tap != taps[0]) return false;
+    }
+    return taps[0] != 0;
+}
+
+static int taps_cost(const vector<int> &taps, bool box) {
+    if(box) return 2;
+    int cost = 0;
+    for(int tap : taps) cost += tap != 0;
+    return cost;
+}
+
+// Picks independent rows, box rows first since they become running sums.
+static void pick_basis(const int *filter, int n, vector<int> &rows, vector<int> &columns) {
+    vector<int> order(n);
+    iota(order.begin(), order.end(), 0);
+    stable_partition(order.begin(), order.end(), [&](int r) {
+        return is_box(vector<int>(filter + r * n, filter + r * n + n));
+    });
+
+    vector<vector<double>> reduced;
+    for(int r : order) {
+        vector<double> v(filter + r * n, filter + r * n + n);
+        for(size_t k = 0; k < reduced.size(); ++k) {
+            double f = v[columns[k]] / reduced[k][columns[k]];
+            for(int j = 0; j < n; ++j) v[j] -= f * reduced[k][j];
+        }
+        int pivot = -1;
+        for(int j = 0; j < n; ++j) {
+            if(fabs(v[j]) > 1e-9 && (pivot < 0 || fabs(v[j]) > fabs(v[pivot]))) pivot = j;
+        }
+        if(pivot < 0) continue;
+        rows.push_back(r);
+        columns.push_back(pivot);
+        reduced.push_back(v);
+    }
+}
+
+separable_filter separable_factor(const int *filter, int n) {
+    separable_filter result;
+    result.valid = false;
+    result.size = n;
+    result.denominator = 1;
+    result.cost = 0;
+
+    vector<int> rows, columns;
+    pick_basis(filter, n, rows, columns);
+    int rank = rows.size();
+    if(rank == 0) return result;
+
+    vector<vector<long long>> core(rank, vector<long long>(rank));
+    for(int a = 0; a < rank; ++a) {
+        for(int b = 0; b < rank; ++b) core[a][b] = filter[rows[a] * n + columns[b]];
+    }
+    long long det = determinant(core);
+    if(det == 0) return result;
+
+    // adjugate[b][a] = (-1)^(a+b) * minor(a, b)
+    vector<vector<long long>> adjugate(rank, vector<long long>(rank, 1));
+    if(rank > 1) {
+        for(int a = 0; a < rank; ++a) {
+            for(int b = 0; b < rank; ++b) {
+                vector<vector<long long>> minor;
+                for(int i = 0; i < rank; ++i) {
+                    if(i == a) continue;
+                    vector<long long> line;
+                    for(int j = 0; j < rank; ++j) {
+                        if(j != b) line.push_back(core[i][j]);
+                    }
+                    minor.push_back(line);
+                }
+                adjugate[b][a] = ((a + b) % 2 ? -1 : 1) * determinant(minor);
+            }
+        }
+    }
+
+    // column factors K[:,Q] * adj, normalized so the denominator is positive and reduced
+    vector<vector<long long>> factors(n, vector<long long>(rank, 0));
+    long long divisor = llabs(det);
+    for(int i = 0; i < n; ++i) {
+        for(int k = 0; k < rank; ++k) {
+            for(int m = 0; m < rank; ++m) factors[i][k] += (long long)filter[i * n + columns[m]] * adjugate[m][k];
+            if(det < 0) factors[i][k] = -factors[i][k];
+            divisor = gcd(divisor, llabs(factors[i][k]));
+        }
+    }
+    long long denominator = llabs(det) / divisor;
+
+    long long bound = 0;
+    for(int k = 0; k < rank; ++k) {
+        separable_term term;
+        long long column_sum = 0, row_sum = 0;
+        for(int i = 0; i < n; ++i) {
+            long long tap = factors[i][k] / divisor;
+            if(llabs(tap) > INT_MAX / 255) return result;
+            term.column.push_back(tap);
+            column_sum += llabs(tap);
+        }
+        for(int j = 0; j < n; ++j) {
+            term.row.push_back(filter[rows[k] * n + j]);
+            row_sum += abs(filter[rows[k] * n + j]);
+        }
+        term.column_box = is_box(term.column);
+        term.row_box = is_box(term.row);
+        bound += 255 * column_sum * row_sum;
+        result.cost += taps_cost(term.column, term.column_box) + taps_cost(term.row, term.row_box);
+        result.terms.push_back(term);
+    }
+    if(bound > INT_MAX) return result;
+
+    for(int i = 0; i < n; ++i) {
+        for(int j = 0; j < n; ++j) {
+            long long sum = 0;
+            for(const separable_term &term : result.terms) sum += (long long)term.column[i] * term.row[j];
+            if(sum != denominator * filter[i * n + j]) return result;
+        }
+    }
+    result.denominator = denominator;
+    result.valid = true;
+    return result;
+}
+
+// Running state of one term across the rows of a grid.
+struct term_pass {
+    const separable_term *term;
+    vector<int> columns;
+};
+
+template<typename T>
+static void vertical_pass(const T *input, int width, int offset, int first_w, int i, bool first_row, term_pass &pass) {
+    const separable_term &term = *pass.term;
+    int span = pass.columns.size();
+    int *columns = pass.columns.data();
+    if(term.column_box) {
+        if(first_row) {
+            for(int y = 0; y < span; ++y) columns[y] = 0;
+            for(int a = -offset; a <= offset; ++a) {
+                const T *line = input + (i + a) * width + first_w;
+                for(int y = 0; y < span; ++y) columns[y] += line[y];
+            }
+        }
+        else {
+            const T *incoming = input + (i + offset) * width + first_w;
+            const T *outgoing = input + (i - offset - 1) * width + first_w;
+            for(int y = 0; y < span; ++y) columns[y] += incoming[y] - outgoing[y];
+        }
+        return;
+    }
+    for(int y = 0; y < span; ++y) columns[y] = 0;
+    for(int a = 0; a < (int)term.column.size(); ++a) {
+        int tap = term.column[a];
+        if(tap == 0) continue;
+        const T *line = input + (i - offset + a) * width + first_w;
+        for(int y = 0; y < span; ++y) columns[y] += tap * line[y];
+    }
+}
+
+static void horizontal_pass(const term_pass &pass, int count, int *sums) {
+    const separable_term &term = *pass.term;
+    const int *columns = pass.columns.data();
+    int size = term.row.size();
+    if(term.row_box) {
+        // box column sums were kept unscaled, the single scale is applied here
+        int scale = term.row[0] * (term.column_box ? term.column[0] : 1);
+        int running = 0;
+        for(int b = 0; b < size; ++b) running += columns[b];
+        for(int j = 0; j < count; ++j) {
+            sums[j] += scale * running;
+            if(j + 1 < count) running += columns[j + size] - columns[j];
+        }
+        return;
+    }
+    int scale = term.column_box ? term.column[0] : 1;
+    for(int b = 0; b < size; ++b) {
+        int tap = term.row[b] * scale;
+        if(tap == 0) continue;
+        for(int j = 0; j < count; ++j) sums[j] += tap * columns[j + b];
+    }
+}
+
+template<typename T>
+void separable_prewitt(const T *input_matrix, T *output_matrix, const separable_filter &filter_h, const separable_filter &filter_v, int width, pixel_grid grid) {
+    int offset = (filter_h.size - 1) / 2;
+    int count = grid.end_w - grid.start_w;
+    if(count <= 0 || grid.end_h <= grid.start_h) return;
+    int span = count + 2 * offset;
+    int first_w = grid.start_w - offset;
+
+    vector<term_pass> passes_h, passes_v;
+    for(const separable_term &term : filter_h.terms) passes_h.push_back({&term, vector<int>(span)});
+    for(const separable_term &term : filter_v.terms) passes_v.push_back({&term, vector<int>(span)});
+    vector<int> sums_h(count), sums_v(count);
+
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        bool first_row = i == grid.start_h;
+        fill(sums_h.begin(), sums_h.end(), 0);
+        fill(sums_v.begin(), sums_v.end(), 0);
+        for(term_pass &pass : passes_h) {
+            vertical_pass(input_matrix, width, offset, first_w, i, first_row, pass);
+            horizontal_pass(pass, count, sums_h.data());
+        }
+        for(term_pass &pass : passes_v) {
+            vertical_pass(input_matrix, width, offset, first_w, i, first_row, pass);
+            horizontal_pass(pass, count, sums_v.data());
+        }
+        T *out = output_matrix + i * width + grid.start_w;
+        for(int j = 0; j < count; ++j) {
+            int horizontal_sum = sums_h[j] / filter_h.denominator;
+            int vertical_sum = sums_v[j] / filter_v.denominator;
+            out[j] = (abs(horizontal_sum) + abs(vertical_sum)) > THRESHOLD ? 255 : 0;
+        }
+    }
+}
+
+template void separable_prewitt<int>(const int *, int *, const separable_filter &, const separable_filter &, int, pixel_grid);
+template void separable_prewitt<pixel>(const pixel *, pixel *, const separable_filter &, const separable_filter &, int, pixel_grid);
@@ -0,0 +1,26 @@
+#include <vector>
+#include "kernels.h"
+
+#pragma once
+
+// One rank-1 piece of a filter: column (vertical taps) times row (horizontal
+// taps). A box vector has all taps equal and is evaluated as a running sum.
+struct separable_term {
+    std::vector<int> column;
+    std::vector<int> row;
+    bool column_box;
+    bool row_box;
+};
+
+// denominator * filter == sum of column * row over all terms, exactly.
+struct separable_filter {
+    bool valid;
+    int size;
+    int denominator;
+    int cost;
+    std::vector<separable_term> terms;
+};
+
+separable_filter separable_factor(const int *, int);
+template<typename T>
+void separable_prewitt(const T *, T *, const separable_filter &, const separable_filter &, int, pixel_grid);
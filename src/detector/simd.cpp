@@ -0,0 +1,547 @@
+#include "simd.h"
+#include <immintrin.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+// Vector versions of prewitt_convolve and edge_detection_p_and_o. Every kernel
+// walks a row of the grid producing 4/8/16 outputs per iteration and falls back
+// to the scalar functions for the tail, so results are bit-identical to them.
+// 5x5 sums overflow int16, so lanes are int32; uint8_t pixels are widened on
+// load and narrowed again on store. The Prewitt kernels can also store the
+// raw |Gh| + |Gv| as saturated uint16_t for later re-thresholding.
+
+static simd_isa clamp_isa(simd_isa isa) {
+    simd_isa best = simd_detect_isa();
+    return isa > best ? best : isa;
+}
+
+static simd_isa initial_isa() {
+    const char *forced = getenv("EDGE_SIMD_ISA");
+    if(forced != nullptr) {
+        for(int isa = ISA_SCALAR; isa <= ISA_AVX512; ++isa) {
+            if(strcmp(forced, simd_isa_name((simd_isa)isa)) == 0) return clamp_isa((simd_isa)isa);
+        }
+    }
+    return simd_detect_isa();
+}
+
+// Function-local so Detectors built during static initialization see the real ISA.
+static simd_isa &active_isa() {
+    static simd_isa isa = initial_isa();
+    return isa;
+}
+
+simd_isa simd_detect_isa() {
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return ISA_AVX512;
+    if(__builtin_cpu_supports("avx2")) return ISA_AVX2;
+    if(__builtin_cpu_supports("sse4.1")) return ISA_SSE41;
+    return ISA_SCALAR;
+}
+
+simd_isa simd_active_isa() {
+    return active_isa();
+}
+
+void simd_set_isa(simd_isa isa) {
+    active_isa() = clamp_isa(isa);
+}
+
+const char *simd_isa_name(simd_isa isa) {
+    switch(isa) {
+        case ISA_SSE41: return "sse4.1";
+        case ISA_AVX2: return "avx2";
+        case ISA_AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+template<bool Magnitude, typename T, typename O>
+static void scalar_prewitt_tail(const T *input, O *output, const int *filter_h, const int *filter_v, int width, int filter_size, int i, int start_w, int end_w) {
+    for(int j = start_w; j < end_w; ++j) {
+        if constexpr(Magnitude) output[i * width + j] = std::min(prewitt_gradient(input, filter_h, filter_v, i, j, width, filter_size), 65535);
+        else output[i * width + j] = prewitt_convolve(input, filter_h, filter_v, i, j, width, filter_size);
+    }
+}
+
+template<typename T>
+static void scalar_edge_tail(const T *input, T *output, int width, int filter_size, int i, int start_w, int end_w) {
+    for(int j = start_w; j < end_w; ++j) {
+        output[i * width + j] = edge_detection_p_and_o(input, width, i, j, filter_size);
+    }
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i load_x4(const int *p) { return _mm_loadu_si128((const __m128i *)p); }
+__attribute__((target("sse4.1")))
+static inline __m128i load_x4(const uint8_t *p) { int v; memcpy(&v, p, 4); return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)); }
+__attribute__((target("sse4.1")))
+static inline void store_x4(int *p, __m128i v) { _mm_storeu_si128((__m128i *)p, v); }
+__attribute__((target("sse4.1")))
+static inline void store_x4(uint8_t *p, __m128i v) {
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(v, v), v));
+    memcpy(p, &packed, 4);
+}
+__attribute__((target("sse4.1")))
+static inline void store_x4(uint16_t *p, __m128i v) { _mm_storel_epi64((__m128i *)p, _mm_packus_epi32(v, v)); }
+
+__attribute__((target("avx2")))
+static inline __m256i load_x8(const int *p) { return _mm256_loadu_si256((const __m256i *)p); }
+__attribute__((target("avx2")))
+static inline __m256i load_x8(const uint8_t *p) { return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p)); }
+__attribute__((target("avx2")))
+static inline void store_x8(int *p, __m256i v) { _mm256_storeu_si256((__m256i *)p, v); }
+__attribute__((target("avx2")))
+static inline void store_x8(uint8_t *p, __m256i v) {
+    // packs work per 128-bit lane, so bytes 0-3 land in dword 0 and 4-7 in dword 4
+    __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(v, v), v);
+    packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+    _mm_storel_epi64((__m128i *)p, _mm256_castsi256_si128(packed));
+}
+__attribute__((target("avx2")))
+static inline void store_x8(uint16_t *p, __m256i v) {
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08);
+    _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(packed));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i load_x16(const int *p) { return _mm512_loadu_si512((const void *)p); }
+__attribute__((target("avx512f")))
+static inline __m512i load_x16(const uint8_t *p) { return _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)p)); }
+__attribute__((target("avx512f")))
+static inline void store_x16(int *p, __m512i v) { _mm512_storeu_si512((void *)p, v); }
+__attribute__((target("avx512f")))
+static inline void store_x16(uint8_t *p, __m512i v) { _mm_storeu_si128((__m128i *)p, _mm512_cvtepi32_epi8(v)); }
+__attribute__((target("avx512f")))
+static inline void store_x16(uint16_t *p, __m512i v) { _mm256_storeu_si256((__m256i *)p, _mm512_cvtusepi32_epi16(v)); }
+
+template<bool Magnitude, typename T, typename O>
+__attribute__((target("sse4.1")))
+static void prewitt_sse41(const T *input, O *output, const int *filter_h, const int *filter_v, int width, int filter_size, pixel_grid grid) {
+    int offset = (filter_size - 1) / 2;
+    const __m128i threshold = _mm_set1_epi32(THRESHOLD);
+    const __m128i white = _mm_set1_epi32(255);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        int j = grid.start_w;
+        for(; j + 4 <= grid.end_w; j += 4) {
+            __m128i h = _mm_setzero_si128(), v = _mm_setzero_si128();
+            for(int a = 0; a < filter_size; ++a) {
+                const T *row = input + (i - offset + a) * width + (j - offset);
+                for(int b = 0; b < filter_size; ++b) {
+                    __m128i p = load_x4(row + b);
+                    h = _mm_add_epi32(h, _mm_mullo_epi32(p, _mm_set1_epi32(filter_h[a * filter_size + b])));
+                    v = _mm_add_epi32(v, _mm_mullo_epi32(p, _mm_set1_epi32(filter_v[a * filter_size + b])));
+                }
+            }
+            __m128i sum = _mm_add_epi32(_mm_abs_epi32(h), _mm_abs_epi32(v));
+            if constexpr(Magnitude) {
+                store_x4(output + i * width + j, sum);
+            } else {
+                __m128i edge = _mm_and_si128(_mm_cmpgt_epi32(sum, threshold), white);
+                store_x4(output + i * width + j, edge);
+            }
+        }
+        scalar_prewitt_tail<Magnitude>(input, output, filter_h, filter_v, width, filter_size, i, j, grid.end_w);
+    }
+}
+
+template<bool Magnitude, typename T, typename O>
+__attribute__((target("avx2")))
+static void prewitt_avx2(const T *input, O *output, const int *filter_h, const int *filter_v, int width, int filter_size, pixel_grid grid) {
+    int offset = (filter_size - 1) / 2;
+    const __m256i threshold = _mm256_set1_epi32(THRESHOLD);
+    const __m256i white = _mm256_set1_epi32(255);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        int j = grid.start_w;
+        for(; j + 8 <= grid.end_w; j += 8) {
+            __m256i h = _mm256_setzero_si256(), v = _mm256_setzero_si256();
+            for(int a = 0; a < filter_size; ++a) {
+                const T *row = input + (i - offset + a) * width + (j - offset);
+                for(int b = 0; b < filter_size; ++b) {
+                    __m256i p = load_x8(row + b);
+                    h = _mm256_add_epi32(h, _mm256_mullo_epi32(p, _mm256_set1_epi32(filter_h[a * filter_size + b])));
+                    v = _mm256_add_epi32(v, _mm256_mullo_epi32(p, _mm256_set1_epi32(filter_v[a * filter_size + b])));
+                }
+            }
+            __m256i sum = _mm256_add_epi32(_mm256_abs_epi32(h), _mm256_abs_epi32(v));
+            if constexpr(Magnitude) {
+                store_x8(output + i * width + j, sum);
+            } else {
+                __m256i edge = _mm256_and_si256(_mm256_cmpgt_epi32(sum, threshold), white);
+                store_x8(output + i * width + j, edge);
+            }
+        }
+        scalar_prewitt_tail<Magnitude>(input, output, filter_h, filter_v, width, filter_size, i, j, grid.end_w);
+    }
+}
+
+template<bool Magnitude, typename T, typename O>
+__attribute__((target("avx512f")))
+static void prewitt_avx512(const T *input, O *output, const int *filter_h, const int *filter_v, int width, int filter_size, pixel_grid grid) {
+    int offset = (filter_size - 1) / 2;
+    const __m512i threshold = _mm512_set1_epi32(THRESHOLD);
+    const __m512i white = _mm512_set1_epi32(255);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        int j = grid.start_w;
+        for(; j + 16 <= grid.end_w; j += 16) {
+            __m512i h = _mm512_setzero_si512(), v = _mm512_setzero_si512();
+            for(int a = 0; a < filter_size; ++a) {
+                const T *row = input + (i - offset + a) * width + (j - offset);
+                for(int b = 0; b < filter_size; ++b) {
+                    __m512i p = load_x16(row + b);
+                    h = _mm512_add_epi32(h, _mm512_mullo_epi32(p, _mm512_set1_epi32(filter_h[a * filter_size + b])));
+                    v = _mm512_add_epi32(v, _mm512_mullo_epi32(p, _mm512_set1_epi32(filter_v[a * filter_size + b])));
+                }
+            }
+            __m512i sum = _mm512_add_epi32(_mm512_abs_epi32(h), _mm512_abs_epi32(v));
+            if constexpr(Magnitude) {
+                store_x16(output + i * width + j, sum);
+            } else {
+                __mmask16 edge = _mm512_cmpgt_epi32_mask(sum, threshold);
+                store_x16(output + i * width + j, _mm512_maskz_mov_epi32(edge, white));
+            }
+        }
+        scalar_prewitt_tail<Magnitude>(input, output, filter_h, filter_v, width, filter_size, i, j, grid.end_w);
+    }
+}
+
+// p is set when the window max reaches THRESHOLD and o stays set only while the
+// window min does, so abs(p - o) == 1 is exactly max >= THRESHOLD && min < THRESHOLD.
+
+template<typename T>
+__attribute__((target("sse4.1")))
+static void edge_sse41(const T *input, T *output, int width, int filter_size, pixel_grid grid) {
+    int offset = (filter_size - 1) / 2;
+    const __m128i threshold = _mm_set1_epi32(THRESHOLD);
+    const __m128i below = _mm_set1_epi32(THRESHOLD - 1);
+    const __m128i white = _mm_set1_epi32(255);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        int j = grid.start_w;
+        for(; j + 4 <= grid.end_w; j += 4) {
+            __m128i hi = _mm_set1_epi32(INT32_MIN), lo = _mm_set1_epi32(INT32_MAX);
+            for(int a = 0; a < filter_size; ++a) {
+                const T *row = input + (i - offset + a) * width + (j - offset);
+                for(int b = 0; b < filter_size; ++b) {
+                    __m128i p = load_x4(row + b);
+                    hi = _mm_max_epi32(hi, p);
+                    lo = _mm_min_epi32(lo, p);
+                }
+            }
+            __m128i edge = _mm_and_si128(_mm_cmpgt_epi32(hi, below), _mm_cmplt_epi32(lo, threshold));
+            store_x4(output + i * width + j, _mm_and_si128(edge, white));
+        }
+        scalar_edge_tail(input, output, width, filter_size, i, j, grid.end_w);
+    }
+}
+
+template<typename T>
+__attribute__((target("avx2")))
+static void edge_avx2(const T *input, T *output, int width, int filter_size, pixel_grid grid) {
+    int offset = (filter_size - 1) / 2;
+    const __m256i threshold = _mm256_set1_epi32(THRESHOLD);
+    const __m256i below = _mm256_set1_epi32(THRESHOLD - 1);
+    const __m256i white = _mm256_set1_epi32(255);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        int j = grid.start_w;
+        for(; j + 8 <= grid.end_w; j += 8) {
+            __m256i hi = _mm256_set1_epi32(INT32_MIN), lo = _mm256_set1_epi32(INT32_MAX);
+            for(int a = 0; a < filter_size; ++a) {
+                const T *row = input + (i - offset + a) * width + (j - offset);
+                for(int b = 0; b < filter_size; ++b) {
+                    __m256i p = load_x8(row + b);
+                    hi = _mm256_max_epi32(hi, p);
+                    lo = _mm256_min_epi32(lo, p);
+                }
+            }
+            __m256i edge = _mm256_and_si256(_mm256_cmpgt_epi32(hi, below), _mm256_cmpgt_epi32(threshold, lo));
+            store_x8(output + i * width + j, _mm256_and_si256(edge, white));
+        }
+        scalar_edge_tail(input, output, width, filter_size, i, j, grid.end_w);
+    }
+}
+
+template<typename T>
+__attribute__((target("avx512f")))
+static void edge_avx512(const T *input, T *output, int width, int filter_size, pixel_grid grid) {
+    int offset = (filter_size - 1) / 2;
+    const __m512i threshold = _mm512_set1_epi32(THRESHOLD);
+    const __m512i white = _mm512_set1_epi32(255);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        int j = grid.start_w;
+        for(; j + 16 <= grid.end_w; j += 16) {
+            __m512i hi = _mm512_set1_epi32(INT32_MIN), lo = _mm512_set1_epi32(INT32_MAX);
+            for(int a = 0; a < filter_size; ++a) {
+                const T *row = input + (i - offset + a) * width + (j - offset);
+                for(int b = 0; b < filter_size; ++b) {
+                    __m512i p = load_x16(row + b);
+                    hi = _mm512_max_epi32(hi, p);
+                    lo = _mm512_min_epi32(lo, p);
+                }
+            }
+            __mmask16 edge = _mm512_cmpge_epi32_mask(hi, threshold) & _mm512_cmplt_epi32_mask(lo, threshold);
+            store_x16(output + i * width + j, _mm512_maskz_mov_epi32(edge, white));
+        }
+        scalar_edge_tail(input, output, width, filter_size, i, j, grid.end_w);
+    }
+}
+
+template<typename T>
+void simd_prewitt(const T *input, T *output, const int *filter_h, const int *filter_v, int width, int filter_size, pixel_grid grid) {
+    switch(active_isa()) {
+        case ISA_AVX512: prewitt_avx512<false>(input, output, filter_h, filter_v, width, filter_size, grid); break;
+        case ISA_AVX2: prewitt_avx2<false>(input, output, filter_h, filter_v, width, filter_size, grid); break;
+        case ISA_SSE41: prewitt_sse41<false>(input, output, filter_h, filter_v, width, filter_size, grid); break;
+        default:
+            for(int i = grid.start_h; i < grid.end_h; ++i) {
+                scalar_prewitt_tail<false>(input, output, filter_h, filter_v, width, filter_size, i, grid.start_w, grid.end_w);
+            }
+            break;
+    }
+}
+
+template<typename T>
+void simd_gradient(const T *input, gradient *output, const int *filter_h, const int *filter_v, int width, int filter_size, pixel_grid grid) {
+    switch(active_isa()) {
+        case ISA_AVX512: prewitt_avx512<true>(input, output, filter_h, filter_v, width, filter_size, grid); break;
+        case ISA_AVX2: prewitt_avx2<true>(input, output, filter_h, filter_v, width, filter_size, grid); break;
+        case ISA_SSE41: prewitt_sse41<true>(input, output, filter_h, filter_v, width, filter_size, grid); break;
+        default:
+            for(int i = grid.start_h; i < grid.end_h; ++i) {
+                scalar_prewitt_tail<true>(input, output, filter_h, filter_v, width, filter_size, i, grid.start_w, grid.end_w);
+            }
+            break;
+    }
+}
+
+template<typename T>
+void simd_edge_detection(const T *input, T *output, int width, int filter_size, pixel_grid grid) {
+    switch(active_isa()) {
+        case ISA_AVX512: edge_avx512(input, output, width, filter_size, grid); break;
+        case ISA_AVX2: edge_avx2(input, output, width, filter_size, grid); break;
+        case ISA_SSE41: edge_sse41(input, output, width, filter_size, grid); break;
+        default:
+            for(int i = grid.start_h; i < grid.end_h; ++i) {
+                scalar_edge_tail(input, output, width, filter_size, i, grid.start_w, grid.end_w);
+            }
+            break;
+    }
+}
+
+// Narrow kernels: only the nonzero taps are loaded, and for an antisymmetric
+// pair (paired) each tap takes the pixel minus its mirror once for both sums.
+// With fits_int16 the lanes are int16, twice as many per vector, and
+// |Gh| + |Gv| fits uint16 exactly.
+
+template<bool Magnitude, typename O>
+static void scalar_narrow_tail(const pixel *input, O *output, const filter_tap *taps, int tap_count, bool paired, int width, int i, int start_w, int end_w) {
+    for(int j = start_w; j < end_w; ++j) {
+        const pixel *center = input + i * width + j;
+        int h = 0, v = 0;
+        for(int t = 0; t < tap_count; ++t) {
+            int offset = taps[t].dy * width + taps[t].dx;
+            int p = paired ? center[offset] - center[-offset] : center[offset];
+            h += taps[t].h * p;
+            v += taps[t].v * p;
+        }
+        int sum = abs(h) + abs(v);
+        if constexpr(Magnitude) output[i * width + j] = std::min(sum, 65535);
+        else output[i * width + j] = sum > THRESHOLD ? 255 : 0;
+    }
+}
+
+template<bool Magnitude, typename O>
+__attribute__((target("sse4.1")))
+static void narrow_sse41(const pixel *input, O *output, const filter_tap *taps, int tap_count, bool paired, int width, pixel_grid grid) {
+    const __m128i above = _mm_set1_epi16(THRESHOLD + 1);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        int j = grid.start_w;
+        for(; j + 8 <= grid.end_w; j += 8) {
+            const pixel *center = input + i * width + j;
+            __m128i h = _mm_setzero_si128(), v = _mm_setzero_si128();
+            for(int t = 0; t < tap_count; ++t) {
+                int offset = taps[t].dy * width + taps[t].dx;
+                __m128i p = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(center + offset)));
+                if(paired) p = _mm_sub_epi16(p, _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(center - offset))));
+                h = _mm_add_epi16(h, _mm_mullo_epi16(p, _mm_set1_epi16(taps[t].h)));
+                v = _mm_add_epi16(v, _mm_mullo_epi16(p, _mm_set1_epi16(taps[t].v)));
+            }
+            __m128i sum = _mm_add_epi16(_mm_abs_epi16(h), _mm_abs_epi16(v));
+            if constexpr(Magnitude) {
+                _mm_storeu_si128((__m128i *)(output + i * width + j), sum);
+            } else {
+                __m128i edge = _mm_cmpeq_epi16(_mm_max_epu16(sum, above), sum);
+                _mm_storel_epi64((__m128i *)(output + i * width + j), _mm_packs_epi16(edge, edge));
+            }
+        }
+        scalar_narrow_tail<Magnitude>(input, output, taps, tap_count, paired, width, i, j, grid.end_w);
+    }
+}
+
+template<bool Magnitude, typename O>
+__attribute__((target("avx2")))
+static void narrow_avx2(const pixel *input, O *output, const filter_tap *taps, int tap_count, bool paired, int width, pixel_grid grid) {
+    const __m256i above = _mm256_set1_epi16(THRESHOLD + 1);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        int j = grid.start_w;
+        for(; j + 16 <= grid.end_w; j += 16) {
+            const pixel *center = input + i * width + j;
+            __m256i h = _mm256_setzero_si256(), v = _mm256_setzero_si256();
+            for(int t = 0; t < tap_count; ++t) {
+                int offset = taps[t].dy * width + taps[t].dx;
+                __m256i p = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(center + offset)));
+                if(paired) p = _mm256_sub_epi16(p, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(center - offset))));
+                h = _mm256_add_epi16(h, _mm256_mullo_epi16(p, _mm256_set1_epi16(taps[t].h)));
+                v = _mm256_add_epi16(v, _mm256_mullo_epi16(p, _mm256_set1_epi16(taps[t].v)));
+            }
+            __m256i sum = _mm256_add_epi16(_mm256_abs_epi16(h), _mm256_abs_epi16(v));
+            if constexpr(Magnitude) {
+                _mm256_storeu_si256((__m256i *)(output + i * width + j), sum);
+            } else {
+                // packs works per 128-bit lane, the permute joins the two low halves
+                __m256i edge = _mm256_cmpeq_epi16(_mm256_max_epu16(sum, above), sum);
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(edge, edge), 0x08);
+                _mm_storeu_si128((__m128i *)(output + i * width + j), _mm256_castsi256_si128(packed));
+            }
+        }
+        scalar_narrow_tail<Magnitude>(input, output, taps, tap_count, paired, width, i, j, grid.end_w);
+    }
+}
+
+template<bool Magnitude, typename O>
+__attribute__((target("avx512f,avx512bw")))
+static void narrow_avx512(const pixel *input, O *output, const filter_tap *taps, int tap_count, bool paired, int width, pixel_grid grid) {
+    const __m512i threshold = _mm512_set1_epi16(THRESHOLD);
+    const __m512i white = _mm512_set1_epi16(255);
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        int j = grid.start_w;
+        for(; j + 32 <= grid.end_w; j += 32) {
+            const pixel *center = input + i * width + j;
+            __m512i h = _mm512_setzero_si512(), v = _mm512_setzero_si512();
+            for(int t = 0; t < tap_count; ++t) {
+                int offset = taps[t].dy * width + taps[t].dx;
+                __m512i p = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(center + offset)));
+                if(paired) p = _mm512_sub_epi16(p, _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(center - offset))));
+                h = _mm512_add_epi16(h, _mm512_mullo_epi16(p, _mm512_set1_epi16(taps[t].h)));
+                v = _mm512_add_epi16(v, _mm512_mullo_epi16(p, _mm512_set1_epi16(taps[t].v)));
+            }
+            __m512i sum = _mm512_add_epi16(_mm512_abs_epi16(h), _mm512_abs_epi16(v));
+            if constexpr(Magnitude) {
+                _mm512_storeu_si512((void *)(output + i * width + j), sum);
+            } else {
+                __mmask32 edge = _mm512_cmpgt_epu16_mask(sum, threshold);
+                _mm256_storeu_si256((__m256i *)(output + i * width + j), _mm512_cvtepi16_epi8(_mm512_maskz_mov_epi16(edge, white)));
+            }
+        }
+        scalar_narrow_tail<Magnitude>(input, output, taps, tap_count, paired, width, i, j, grid.end_w);
+    }
+}
+
+// 16-bit lanes on 512-bit vectors need AVX512BW; without it AVX-512 runs the AVX2 kernel.
+template<bool Magnitude, typename O>
+static void narrow_dispatch(const pixel *input, O *output, const filter_tap *taps, int tap_count, bool paired, int width, pixel_grid grid) {
+    switch(active_isa()) {
+        case ISA_AVX512:
+            if(__builtin_cpu_supports("avx512bw")) {
+                narrow_avx512<Magnitude>(input, output, taps, tap_count, paired, width, grid);
+                break;
+            }
+            narrow_avx2<Magnitude>(input, output, taps, tap_count, paired, width, grid);
+            break;
+        case ISA_AVX2: narrow_avx2<Magnitude>(input, output, taps, tap_count, paired, width, grid); break;
+        case ISA_SSE41: narrow_sse41<Magnitude>(input, output, taps, tap_count, paired, width, grid); break;
+        default:
+            for(int i = grid.start_h; i < grid.end_h; ++i) {
+                scalar_narrow_tail<Magnitude>(input, output, taps, tap_count, paired, width, i, grid.start_w, grid.end_w);
+            }
+            break;
+    }
+}
+
+void simd_prewitt_narrow(const pixel *input, pixel *output, const filter_tap *taps, int tap_count, bool paired, int width, pixel_grid grid) {
+    narrow_dispatch<false>(input, output, taps, tap_count, paired, width, grid);
+}
+
+void simd_gradient_narrow(const pixel *input, gradient *output, const filter_tap *taps, int tap_count, bool paired, int width, pixel_grid grid) {
+    narrow_dispatch<true>(input, output, taps, tap_count, paired, width, grid);
+}
+
+// Unsigned 16-bit compare as a signed one on values with the top bit flipped;
+// threshold is in 0..65534, the caller handles the all-or-nothing cases.
+
+__attribute__((target("sse4.1")))
+static void threshold_sse41(const gradient *input, pixel *output, int threshold, int count) {
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    const __m128i limit = _mm_set1_epi16((short)(threshold ^ 0x8000));
+    int k = 0;
+    for(; k + 16 <= count; k += 16) {
+        __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(input + k)), bias);
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(input + k + 8)), bias);
+        __m128i edge = _mm_packs_epi16(_mm_cmpgt_epi16(a, limit), _mm_cmpgt_epi16(b, limit));
+        _mm_storeu_si128((__m128i *)(output + k), edge);
+    }
+    for(; k < count; ++k) output[k] = input[k] > threshold ? 255 : 0;
+}
+
+__attribute__((target("avx2")))
+static void threshold_avx2(const gradient *input, pixel *output, int threshold, int count) {
+    const __m256i bias = _mm256_set1_epi16((short)0x8000);
+    const __m256i limit = _mm256_set1_epi16((short)(threshold ^ 0x8000));
+    int k = 0;
+    for(; k + 32 <= count; k += 32) {
+        __m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(input + k)), bias);
+        __m256i b = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(input + k + 16)), bias);
+        // packs interleaves the 128-bit lanes of a and b, the permute puts them back in order
+        __m256i edge = _mm256_packs_epi16(_mm256_cmpgt_epi16(a, limit), _mm256_cmpgt_epi16(b, limit));
+        _mm256_storeu_si256((__m256i *)(output + k), _mm256_permute4x64_epi64(edge, 0xD8));
+    }
+    for(; k < count; ++k) output[k] = input[k] > threshold ? 255 : 0;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void threshold_avx512(const gradient *input, pixel *output, int threshold, int count) {
+    const __m512i limit = _mm512_set1_epi16((short)threshold);
+    const __m512i white = _mm512_set1_epi8((char)255);
+    int k = 0;
+    for(; k + 32 <= count; k += 32) {
+        __mmask32 edge = _mm512_cmpgt_epu16_mask(_mm512_loadu_si512((const void *)(input + k)), limit);
+        _mm256_storeu_si256((__m256i *)(output + k), _mm512_castsi512_si256(_mm512_maskz_mov_epi8(edge, white)));
+    }
+    for(; k < count; ++k) output[k] = input[k] > threshold ? 255 : 0;
+}
+
+template<typename T>
+void simd_threshold(const gradient *input, T *output, int threshold, int width, pixel_grid grid) {
+    for(int i = grid.start_h; i < grid.end_h; ++i) {
+        const gradient *in = input + i * width + grid.start_w;
+        T *out = output + i * width + grid.start_w;
+        int count = grid.end_w - grid.start_w;
+        if(threshold < 0 || threshold >= 65535) {
+            std::fill(out, out + count, threshold < 0 ? 255 : 0);
+            continue;
+        }
+        if constexpr(std::is_same_v<T, pixel>) {
+            switch(active_isa()) {
+                case ISA_AVX512:
+                    if(__builtin_cpu_supports("avx512bw")) { threshold_avx512(in, out, threshold, count); continue; }
+                    threshold_avx2(in, out, threshold, count);
+                    continue;
+                case ISA_AVX2: threshold_avx2(in, out, threshold, count); continue;
+                case ISA_SSE41: threshold_sse41(in, out, threshold, count); continue;
+                default: break;
+            }
+        }
+        for(int k = 0; k < count; ++k) out[k] = in[k] > threshold ? 255 : 0;
+    }
+}
+
+template void simd_prewitt<int>(const int *, int *, const int *, const int *, int, int, pixel_grid);
+template void simd_prewitt<pixel>(const pixel *, pixel *, const int *, const int *, int, int, pixel_grid);
+template void simd_edge_detection<int>(const int *, int *, int, int, pixel_grid);
+template void simd_edge_detection<pixel>(const pixel *, pixel *, int, int, pixel_grid);
+template void simd_gradient<int>(const int *, gradient *, const int *, const int *, int, int, pixel_grid);
+template void simd_gradient<pixel>(const pixel *, gradient *, const int *, const int *, int, int, pixel_grid);
+template void simd_threshold<int>(const gradient *, int *, int, int, pixel_grid);
+template void simd_threshold<pixel>(const gradient *, pixel *, int, int, pixel_grid);
@@ -0,0 +1,23 @@
+#include "kernels.h"
+
+#pragma once
+
+enum simd_isa { ISA_SCALAR, ISA_SSE41, ISA_AVX2, ISA_AVX512 };
+
+simd_isa simd_detect_isa();
+simd_isa simd_active_isa();
+void simd_set_isa(simd_isa);
+const char *simd_isa_name(simd_isa);
+
+template<typename T>
+void simd_prewitt(const T *, T *, const int *, const int *, int, int, pixel_grid);
+template<typename T>
+void simd_edge_detection(const T *, T *, int, int, pixel_grid);
+template<typename T>
+void simd_gradient(const T *, gradient *, const int *, const int *, int, int, pixel_grid);
+// Over pixel input with a filter's precomputed taps; only for filters whose
+// sums fit int16 (gradient_filter::fits_int16).
+void simd_prewitt_narrow(const pixel *, pixel *, const filter_tap *, int, bool, int, pixel_grid);
+void simd_gradient_narrow(const pixel *, gradient *, const filter_tap *, int, bool, int, pixel_grid);
+template<typename T>
+void simd_threshold(const gradient *, T *, int, int, pixel_grid);
@@ -0,0 +1,110 @@
+#include "sweep.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+threshold_sweep make_sweep(const vector<int> &thresholds, int width, int height) {
+    threshold_sweep sweep;
+    sweep.thresholds = thresholds;
+    sweep.planes.assign(thresholds.size(), BitPlane(width, height));
+    sweep.counts.assign(thresholds.size(), 0);
+    return sweep;
+}
+
+// The tables span every 8-bit value and one step past either end threshold,
+// so pixel input never needs the clamp.
+sweep_index make_sweep_index(threshold_sweep &sweep) {
+    sweep_index index;
+    int n = sweep.thresholds.size();
+    index.order.resize(n);
+    iota(index.order.begin(), index.order.end(), 0);
+    stable_sort(index.order.begin(), index.order.end(), [&](int a, int b) { return sweep.thresholds[a] < sweep.thresholds[b]; });
+    vector<int> sorted(n);
+    for(int k = 0; k < n; ++k) sorted[k] = sweep.thresholds[index.order[k]];
+
+    index.low = n > 0 ? min(0, sorted.front() - 1) : 0;
+    index.high = n > 0 ? max(255, sorted.back() + 1) : 255;
+    for(int v = index.low; v <= index.high; ++v) {
+        index.below.push_back(lower_bound(sorted.begin(), sorted.end(), v) - sorted.begin());
+        index.at_most.push_back(upper_bound(sorted.begin(), sorted.end(), v) - sorted.begin());
+    }
+    for(int k = 0; k < n; ++k) index.words.push_back(sweep.planes[index.order[k]].row(0));
+    index.words_per_row = n > 0 ? sweep.planes[0].get_words_per_row() : 0;
+    return index;
+}
+
+// Each thread's counts are per sorted threshold, as its blocks added them up.
+void finish_sweep(const sweep_index &index, sweep_counts &counts, threshold_sweep &sweep) {
+    fill(sweep.counts.begin(), sweep.counts.end(), 0);
+    for(const vector<long long> &part : counts) {
+        for(size_t k = 0; k < index.order.size(); ++k) sweep.counts[index.order[k]] += part[k];
+    }
+}
+
+template<typename T>
+static inline int table_offset(const sweep_index &index, T value) {
+    if constexpr(sizeof(T) == 1) return (int)value - index.low;
+    else return min(max((int)value, index.low), index.high) - index.low;
+}
+
+// Every pixel is an edge for a contiguous run [lo, hi) of the sorted
+// thresholds, two table loads. A 64-pixel word toggles the pixel's bit at lo
+// and at hi, and a running XOR up to the highest hi rebuilds the word of every
+// plane, so a word costs 64 + n instead of 64 * n; words that stay zero are
+// never written. values point at the block's first pixel; without Window runs
+// start at 0 and lo_values is unused. Blocks on the same row must not run at
+// the same time.
+template<bool Window, typename T>
+static void sweep_block(const sweep_index &index, const int *lo_table, const T *lo_values, const int *hi_table, const T *hi_values,
+                        int stride, pixel_grid block, long long *counts) {
+    int n = index.order.size();
+    if(n == 0) return;
+    vector<uint64_t> toggle_buffer(n + 1, 0);
+    uint64_t *toggles = toggle_buffer.data();
+    uint64_t *const *planes = index.words.data();
+    for(int i = block.start_h; i < block.end_h; ++i) {
+        size_t row = (size_t)i * index.words_per_row;
+        const T *lo_row = lo_values + (size_t)(i - block.start_h) * stride - block.start_w;
+        const T *hi_row = hi_values + (size_t)(i - block.start_h) * stride - block.start_w;
+        for(int base = block.start_w & ~63; base < block.end_w; base += 64) {
+            int first = Window ? n : 0, last = 0;
+            int begin = max(base, block.start_w), end = min(base + 64, block.end_w);
+            for(int j = begin; j < end; ++j) {
+                uint64_t bit = 1ULL << (j - base);
+                int lo = 0;
+                if constexpr(Window) {
+                    lo = lo_table[table_offset(index, lo_row[j])];
+                    first = min(first, lo);
+                }
+                int hi = hi_table[table_offset(index, hi_row[j])];
+                toggles[lo] ^= bit;
+                toggles[hi] ^= bit;
+                last = max(last, hi);
+            }
+            uint64_t word = 0;
+            for(int k = first; k < last; ++k) {
+                word ^= toggles[k];
+                toggles[k] = 0;
+                if(word == 0) continue;
+                planes[k][row + base / 64] |= word;
+                counts[k] += __builtin_popcountll(word);
+            }
+            toggles[last] = 0;
+        }
+    }
+}
+
+// Prewitt: an edge for every threshold below the gradient.
+void sweep_gradient_block(const sweep_index &index, const gradient *magnitude, int stride, pixel_grid block, long long *counts) {
+    sweep_block<false, gradient>(index, nullptr, magnitude, index.below.data(), magnitude, stride, block, counts);
+}
+
+// P&O: an edge for every threshold t with min < t <= max of the window.
+template<typename T>
+void sweep_window_block(const sweep_index &index, const T *max_matrix, const T *min_matrix, int stride, pixel_grid block, long long *counts) {
+    sweep_block<true, T>(index, index.at_most.data(), min_matrix, index.at_most.data(), max_matrix, stride, block, counts);
+}
+
+template void sweep_window_block<int>(const sweep_index &, const int *, const int *, int, pixel_grid, long long *);
+template void sweep_window_block<pixel>(const sweep_index &, const pixel *, const pixel *, int, pixel_grid, long long *);
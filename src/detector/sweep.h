@@ -0,0 +1,39 @@
+#include <vector>
+#include <tbb/enumerable_thread_specific.h>
+#include "kernels.h"
+#include "bitplane.h"
+
+#pragma once
+
+// One pass over precomputed windows for a whole list of thresholds: planes[k]
+// is the binary map for thresholds[k] and counts[k] its number of edge pixels.
+// Planes cover the full image, pixels outside grid stay zero.
+struct threshold_sweep {
+    std::vector<int> thresholds;
+    std::vector<BitPlane> planes;
+    std::vector<long long> counts;
+};
+
+// Built once per pass. With the thresholds sorted, below[v - low] and
+// at_most[v - low] count those under and up to a value v; values outside
+// [low, high] count like the nearest end. words[k] is the plane of the k-th
+// smallest threshold, so blocks write the planes in sorted order.
+struct sweep_index {
+    std::vector<int> order;
+    int low;
+    int high;
+    std::vector<int> below;
+    std::vector<int> at_most;
+    std::vector<uint64_t *> words;
+    int words_per_row;
+};
+
+// One count per sorted threshold and thread, summed by finish_sweep.
+typedef tbb::enumerable_thread_specific<std::vector<long long>> sweep_counts;
+
+threshold_sweep make_sweep(const std::vector<int> &, int, int);
+sweep_index make_sweep_index(threshold_sweep &);
+void finish_sweep(const sweep_index &, sweep_counts &, threshold_sweep &);
+void sweep_gradient_block(const sweep_index &, const gradient *, int, pixel_grid, long long *);
+template<typename T>
+void sweep_window_block(const sweep_index &, const T *, const T *, int, pixel_grid, long long *);
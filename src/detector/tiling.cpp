@@ -0,0 +1,37 @@
+#include "tiling.h"
+#include <unistd.h>
+#include <vector>
+#include <tbb/cache_aligned_allocator.h>
+
+using namespace std;
+
+static const size_t DEFAULT_CACHE_SIZE = 256 * 1024;
+
+size_t cache_size() {
+    static const long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? (size_t)size : DEFAULT_CACHE_SIZE;
+}
+
+// Input tile with halo and output tile together take about half the cache,
+// sized for int pixels so uint8_t tiles have room to spare. The scratch stride
+// adds the halo and is rounded up to a cache line by tile_stride.
+tile_shape tile_shape_for_cache(size_t cache_bytes, int halo) {
+    size_t pixels = cache_bytes / 2 / (2 * sizeof(int));
+    int width = 64;
+    while((size_t)width * 2 * width * 2 <= pixels && width < 1024) width *= 2;
+    int height = max(1, (int)(pixels / (width + 2 * halo)) - 2 * halo);
+    return tile_shape{width, max(height, 2 * halo + 1)};
+}
+
+// Tiling only pays for its copies once a block's input and output no longer
+// stay in cache together.
+bool exceeds_cache(pixel_grid grid, size_t element) {
+    long long pixels = (long long)(grid.end_w - grid.start_w) * (grid.end_h - grid.start_h);
+    return pixels > 0 && (size_t)pixels * 2 * element > cache_size();
+}
+
+void *tile_scratch(int slot, size_t bytes) {
+    static thread_local vector<char, tbb::cache_aligned_allocator<char>> buffers[3];
+    if(buffers[slot].size() < bytes) buffers[slot].resize(bytes);
+    return buffers[slot].data();
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include "kernels.h"
+
+#pragma once
+
+struct tile_shape {
+    int width;
+    int height;
+};
+
+// set_tiled overrides the default, which tiles only blocks that outgrow the cache.
+enum tiling_mode { TILING_AUTO, TILING_OFF, TILING_ON };
+
+size_t cache_size();
+tile_shape tile_shape_for_cache(size_t, int);
+bool exceeds_cache(pixel_grid, size_t);
+void *tile_scratch(int, size_t);
+
+// Scratch rows are padded to whole cache lines, so every row starts as
+// aligned as the scratch buffer itself.
+template<typename T>
+int tile_stride(tile_shape tile, int halo) {
+    int line = 64 / sizeof(T);
+    return (tile.width + 2 * halo + line - 1) / line * line;
+}
+
+// Runs kernel(input, output, stride, grid) tile by tile. Each tile and its halo
+// is copied into a thread-local scratch buffer first, so the kernel works on a
+// small dense block that stays in cache and never sees the image borders.
+template<typename T, typename Kernel>
+void tiled_run(const T *input_matrix, T *output_matrix, int width, int halo, pixel_grid grid, tile_shape tile, const Kernel &kernel) {
+    int stride = tile_stride<T>(tile, halo);
+    size_t size = (size_t)stride * (tile.height + 2 * halo);
+    T *scratch_in = (T *)tile_scratch(0, size * sizeof(T));
+    T *scratch_out = (T *)tile_scratch(1, size * sizeof(T));
+
+    for(int top = grid.start_h; top < grid.end_h; top += tile.height) {
+        int rows = std::min(tile.height, grid.end_h - top);
+        for(int left = grid.start_w; left < grid.end_w; left += tile.width) {
+            int cols = std::min(tile.width, grid.end_w - left);
+            for(int r = 0; r < rows + 2 * halo; ++r) {
+                memcpy(scratch_in + r * stride, input_matrix + (top - halo + r) * width + left - halo, (cols + 2 * halo) * sizeof(T));
+            }
+            kernel(scratch_in, scratch_out, stride, pixel_grid{halo, halo + cols, halo, halo + rows});
+            for(int r = 0; r < rows; ++r) {
+                memcpy(output_matrix + (top + r) * width + left, scratch_out + (halo + r) * stride + halo, cols * sizeof(T));
+            }
+        }
+    }
+}
+
+// Same walk as tiled_run, but the tile is loaded once and the kernel fills two
+// outputs: kernel(input, output_a, output_b, stride, grid, tile) where tile is
+// the block in image coordinates.
+template<typename T, typename Kernel>
+void tiled_run_fused(const T *input_matrix, T *output_a, T *output_b, int width, int halo, pixel_grid grid, tile_shape tile, const Kernel &kernel) {
+    int stride = tile_stride<T>(tile, halo);
+    size_t size = (size_t)stride * (tile.height + 2 * halo);
+    T *scratch_in = (T *)tile_scratch(0, size * sizeof(T));
+    T *scratch_a = (T *)tile_scratch(1, size * sizeof(T));
+    T *scratch_b = (T *)tile_scratch(2, size * sizeof(T));
+
+    for(int top = grid.start_h; top < grid.end_h; top += tile.height) {
+        int rows = std::min(tile.height, grid.end_h - top);
+        for(int left = grid.start_w; left < grid.end_w; left += tile.width) {
+            int cols = std::min(tile.width, grid.end_w - left);
+            for(int r = 0; r < rows + 2 * halo; ++r) {
+                memcpy(scratch_in + r * stride, input_matrix + (top - halo + r) * width + left - halo, (cols + 2 * halo) * sizeof(T));
+            }
+            kernel(scratch_in, scratch_a, scratch_b, stride, pixel_grid{halo, halo + cols, halo, halo + rows}, pixel_grid{left, left + cols, top, top + rows});
+            for(int r = 0; r < rows; ++r) {
+                memcpy(output_a + (top + r) * width + left, scratch_a + (halo + r) * stride + halo, cols * sizeof(T));
+                memcpy(output_b + (top + r) * width + left, scratch_b + (halo + r) * stride + halo, cols * sizeof(T));
+            }
+        }
+    }
+}
+
+// Same walk again for kernels that keep their results to themselves:
+// kernel(input, stride, grid, tile) gets the loaded tile, and may use scratch
+// slots 1 and 2 for anything it derives from it.
+template<typename T, typename Kernel>
+void tiled_for_each(const T *input_matrix, int width, int halo, pixel_grid grid, tile_shape tile, const Kernel &kernel) {
+    int stride = tile_stride<T>(tile, halo);
+    T *scratch_in = (T *)tile_scratch(0, (size_t)stride * (tile.height + 2 * halo) * sizeof(T));
+
+    for(int top = grid.start_h; top < grid.end_h; top += tile.height) {
+        int rows = std::min(tile.height, grid.end_h - top);
+        for(int left = grid.start_w; left < grid.end_w; left += tile.width) {
+            int cols = std::min(tile.width, grid.end_w - left);
+            for(int r = 0; r < rows + 2 * halo; ++r) {
+                memcpy(scratch_in + r * stride, input_matrix + (top - halo + r) * width + left - halo, (cols + 2 * halo) * sizeof(T));
+            }
+            kernel(scratch_in, stride, pixel_grid{halo, halo + cols, halo, halo + rows}, pixel_grid{left, left + cols, top, top + rows});
+        }
+    }
+}
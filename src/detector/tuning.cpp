@@ -0,0 +1,229 @@
+#include "tuning.h"
+#include "detector.h"
+#include "simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+static const char *VARIANT_NAMES[] = {"scalar", "simd", "unrolled", "separable", "running", "bitplane", "compass"};
+static const int TUNING_REPETITIONS = 5;
+
+const char *kernel_variant_name(kernel_variant variant) {
+    return VARIANT_NAMES[variant];
+}
+
+bool parse_kernel_variant(const string &name, kernel_variant *variant) {
+    for(int v = KERNEL_SCALAR; v <= KERNEL_COMPASS; ++v) {
+        if(name != VARIANT_NAMES[v]) continue;
+        *variant = (kernel_variant)v;
+        return true;
+    }
+    return false;
+}
+
+// CPU model, hardware threads, vector ISA and cache sizes: anything that moves
+// the optimum, nothing that changes when the same hardware is rebooted.
+static string cpu_model() {
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while(getline(cpuinfo, line)) {
+        if(line.compare(0, 10, "model name") != 0) continue;
+        string model = line.substr(line.find(':') + 1);
+        model.erase(0, model.find_first_not_of(' '));
+        replace(model.begin(), model.end(), ' ', '_');
+        if(!model.empty()) return model;
+    }
+    return "unknown";
+}
+
+static size_t cache_kb(int name) {
+    long size = sysconf(name);
+    return size > 0 ? size / 1024 : 0;
+}
+
+string machine_id() {
+    static const string id = [] {
+        ostringstream id;
+        id << cpu_model() << "/" << thread::hardware_concurrency() << "t/" << simd_isa_name(simd_detect_isa())
+           << "/l1d-" << cache_kb(_SC_LEVEL1_DCACHE_SIZE) << "k/l2-" << cache_size() / 1024 << "k/l3-" << cache_kb(_SC_LEVEL3_CACHE_SIZE) << "k";
+        return id.str();
+    }();
+    return id;
+}
+
+string tuning_path() {
+    const char *path = getenv("EDGE_TUNING_FILE");
+    return path != nullptr ? path : "../resources/tuning.profile";
+}
+
+// Line based: "machine <id>" then one
+// "entry <filter> <width> <height> <area> <grain> <prewitt_variant> <edge_variant>"
+// per measured configuration. '#' starts a comment line.
+bool load_tuning(const string &path, tuning_profile *profile) {
+    ifstream file(path);
+    if(!file) return false;
+    tuning_profile loaded;
+    string line;
+    int number = 0;
+    while(getline(file, line)) {
+        ++number;
+        istringstream fields(line);
+        string key;
+        if(!(fields >> key) || key[0] == '#') continue;
+        if(key == "machine") {
+            fields >> loaded.machine;
+            if(loaded.machine != machine_id()) break;
+            continue;
+        }
+        if(loaded.machine.empty()) break;
+        tuning_entry entry;
+        string prewitt, edge;
+        if(key != "entry" || !(fields >> entry.filter >> entry.width >> entry.height >> entry.area >> entry.grain >> prewitt >> edge)
+           || !parse_kernel_variant(prewitt, &entry.prewitt_variant) || !parse_kernel_variant(edge, &entry.edge_variant) || entry.grain <= 0) {
+            cout << "ERROR: bad tuning line " << number << " in " << path << "!" << endl;
+            return false;
+        }
+        loaded.entries.push_back(entry);
+    }
+    // a profile from other hardware, or one too old to say, is just not used;
+    // say so once per process
+    if(loaded.machine != machine_id()) {
+        static bool reported = false;
+        if(reported) return false;
+        reported = true;
+        if(loaded.machine.empty()) cout << "Note: tuning profile " << path << " has no machine line; using defaults." << endl;
+        else cout << "Note: tuning profile " << path << " was measured on " << loaded.machine << ", not " << machine_id() << "; using defaults." << endl;
+        return false;
+    }
+    *profile = loaded;
+    return true;
+}
+
+bool save_tuning(const string &path, const tuning_profile &profile) {
+    ofstream file(path);
+    if(!file) {
+        cout << "ERROR: cannot write tuning profile " << path << "!" << endl;
+        return false;
+    }
+    file << "# written by ImageProcessing --autotune" << endl;
+    file << "machine " << profile.machine << endl;
+    for(const tuning_entry &e : profile.entries) {
+        file << "entry " << e.filter << " " << e.width << " " << e.height << " " << e.area << " " << e.grain << " "
+             << kernel_variant_name(e.prewitt_variant) << " " << kernel_variant_name(e.edge_variant) << endl;
+    }
+    return (bool)file;
+}
+
+// Same filter and window, closest pixel count; nullptr when the profile has
+// nothing for this filter and window. Variants are only valid for the filter
+// they were measured with, so filters of one size never share an entry.
+const tuning_entry *find_tuning(const tuning_profile &profile, const string &filter, int width, int height, int area) {
+    const tuning_entry *best = nullptr;
+    long long pixels = (long long)width * height, best_distance = 0;
+    for(const tuning_entry &e : profile.entries) {
+        if(e.filter != filter || e.area != area) continue;
+        long long distance = llabs((long long)e.width * e.height - pixels);
+        if(best == nullptr || distance < best_distance) {
+            best = &e;
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+// Median of a few runs after one untimed warm-up run.
+template<typename Run>
+static double measure(Run run) {
+    run();
+    vector<double> times;
+    for(int r = 0; r < TUNING_REPETITIONS; ++r) {
+        auto start = chrono::steady_clock::now();
+        run();
+        times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// Synthetic image: smooth gradient with noise and a few hard steps, so both
+// detectors see a realistic mix of edge and flat regions.
+vector<pixel> synthetic_image(int width, int height) {
+    vector<pixel> image((size_t)width * height);
+    mt19937 random(width * 31 + height);
+    for(int i = 0; i < height; ++i) {
+        for(int j = 0; j < width; ++j) {
+            int value = (i * 255 / height + j * 255 / width) / 2 + (int)(random() % 32) - 16;
+            if((i / 64 + j / 64) % 5 == 0) value = 255 - value;
+            image[(size_t)i * width + j] = min(max(value, 0), 255);
+        }
+    }
+    return image;
+}
+
+// Coordinate search per configuration: the Prewitt variant at the default
+// grain, then the P&O variant, then the grain for both together. Every run
+// goes through the padded path start_detector uses, on one pad() per
+// configuration, so the stride and grid are the ones production sees.
+tuning_profile autotune(const vector<pair<int, int>> &sizes, const vector<string> &filters, const vector<int> &areas) {
+    tuning_profile profile;
+    profile.machine = machine_id();
+    Detector d;
+    d.set_border(DETECTOR_BORDER, 0);
+    for(const pair<int, int> &size : sizes) {
+        int width = size.first, height = size.second;
+        vector<pixel> input = synthetic_image(width, height);
+        vector<pixel> output((size_t)width * height);
+        d.set_image_width(width);
+        d.set_image_height(height);
+        for(const string &filter : filters) {
+            if(!d.set_filter(filter)) continue;
+            for(int a : areas) {
+                d.set_area(a);
+                const Image<pixel> padded = d.pad(input.data());
+                pixel_grid grid = padded.grid();
+                d.set_grain(0);
+                // one block per hardware thread down to 32, scaled from the default grain
+                vector<long long> grains;
+                for(long long parts : {1, 2, 4, 8, 16, 32}) grains.push_back(max(1LL, default_grain(grid) * TASKS_PER_THREAD / parts));
+
+                tuning_entry entry = {filter, width, height, 2 * a + 1, default_grain(grid), KERNEL_SIMD, KERNEL_SIMD};
+                double best = -1;
+                for(kernel_variant v : {KERNEL_SCALAR, KERNEL_SIMD, KERNEL_UNROLLED, KERNEL_SEPARABLE}) {
+                    d.set_prewitt_variant(v);
+                    double time = measure([&] { d.padded_prewitt(padded, output.data(), true); });
+                    if(best < 0 || time < best) { best = time; entry.prewitt_variant = v; }
+                }
+                d.set_prewitt_variant(entry.prewitt_variant);
+                best = -1;
+                for(kernel_variant v : {KERNEL_SCALAR, KERNEL_SIMD, KERNEL_RUNNING, KERNEL_BITPLANE}) {
+                    d.set_edge_variant(v);
+                    double time = measure([&] { d.padded_edge_detection(padded, output.data(), true); });
+                    if(best < 0 || time < best) { best = time; entry.edge_variant = v; }
+                }
+                d.set_edge_variant(entry.edge_variant);
+                best = -1;
+                for(long long grain : grains) {
+                    d.set_grain(grain);
+                    double time = measure([&] {
+                        d.padded_prewitt(padded, output.data(), true);
+                        d.padded_edge_detection(padded, output.data(), true);
+                    });
+                    if(best < 0 || time < best) { best = time; entry.grain = grain; }
+                }
+                cout << width << "x" << height << " filter " << filter << " area " << entry.area << ": grain " << entry.grain
+                     << ", prewitt " << kernel_variant_name(entry.prewitt_variant) << ", edge " << kernel_variant_name(entry.edge_variant)
+                     << " (" << best << " ms)" << endl;
+                profile.entries.push_back(entry);
+            }
+        }
+    }
+    return profile;
+}
@@ -0,0 +1,36 @@
+#include <string>
+#include <utility>
+#include <vector>
+#include "kernels.h"
+
+#pragma once
+
+// Best grain and kernel variants measured for one image size, filter and P&O
+// window (area is the window width, 2 * a + 1).
+struct tuning_entry {
+    std::string filter;
+    int width;
+    int height;
+    int area;
+    long long grain;
+    kernel_variant prewitt_variant;
+    kernel_variant edge_variant;
+};
+
+// A profile is only valid on the machine it was measured on.
+struct tuning_profile {
+    std::string machine;
+    std::vector<tuning_entry> entries;
+};
+
+const char *kernel_variant_name(kernel_variant);
+bool parse_kernel_variant(const std::string &, kernel_variant *);
+
+std::string machine_id();
+std::string tuning_path();
+bool load_tuning(const std::string &, tuning_profile *);
+bool save_tuning(const std::string &, const tuning_profile &);
+const tuning_entry *find_tuning(const tuning_profile &, const std::string &, int, int, int);
+
+std::vector<pixel> synthetic_image(int, int);
+tuning_profile autotune(const std::vector<std::pair<int, int>> &, const std::vector<std::string> &, const std::vector<int> &);
@@ -0,0 +1,412 @@
+#include "verify.h"
+#include "detector.h"
+#include "simd.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+using namespace std;
+
+static const char *RANGE_NAMES[] = {"grid", "blocked2d", "rows"};
+static const char *PARTITIONER_NAMES[] = {"auto", "simple", "static", "affinity"};
+static const char *BORDER_NAMES[] = {"none", "replicate", "reflect-101", "constant"};
+static const int NOISE_LEVELS[] = {0, 8, 64, 256};
+
+static int comparisons = 0;
+static int failures = 0;
+
+// Compares two full images and reports the first pixel, in row order, that differs.
+template<typename A, typename B>
+static void compare(const string &what, const A *result, const B *expected, int width, int height, const string &context) {
+    ++comparisons;
+    for(int i = 0; i < height; ++i) {
+        for(int j = 0; j < width; ++j) {
+            if((long long)result[i * width + j] == (long long)expected[i * width + j]) continue;
+            ++failures;
+            cout << "Verify FAIL: " << what << " (" << context << ") first mismatch at x " << j << ", y " << i
+                 << ": got " << (long long)result[i * width + j] << ", expected " << (long long)expected[i * width + j] << "!" << endl;
+            return;
+        }
+    }
+}
+
+static void compare_count(const string &what, long long result, long long expected, const string &context) {
+    ++comparisons;
+    if(result == expected) return;
+    ++failures;
+    cout << "Verify FAIL: " << what << " (" << context << ") got " << result << " edge pixels, expected " << expected << "!" << endl;
+}
+
+// Reference images for one source: pixel (x, y) of the image is at
+// source[(y + origin) * stride + x + origin], the results cover width x height
+// and are zero outside grid. Gradients saturate like the stored magnitude.
+struct reference {
+    vector<int> prewitt;
+    vector<int> edge;
+    vector<int> magnitude;
+    vector<int> window_max;
+    vector<int> window_min;
+};
+
+// Largest signed Gd over every direction of a compass set, at least 0,
+// straight from the kernels.
+template<typename T>
+static int compass_strength(const T *source, const gradient_filter &filter, int y, int x, int stride) {
+    int offset = (filter.size - 1) / 2, strongest = 0;
+    for(const vector<int> &kernel : filter.kernels) {
+        int sum = 0;
+        for(int i = 0; i < filter.size; ++i) {
+            for(int j = 0; j < filter.size; ++j) sum += kernel[i * filter.size + j] * source[(y - offset + i) * stride + x - offset + j];
+        }
+        strongest = max(strongest, sum);
+    }
+    return strongest;
+}
+
+template<typename T>
+static reference make_reference(const T *source, int stride, int origin, int width, int height, const gradient_filter &filter,
+                                int window, pixel_grid prewitt_grid, pixel_grid edge_grid) {
+    reference r;
+    size_t size = (size_t)width * height;
+    r.prewitt.assign(size, 0);
+    r.edge.assign(size, 0);
+    r.magnitude.assign(size, 0);
+    r.window_max.assign(size, 0);
+    r.window_min.assign(size, 0);
+    const int *filter_h = filter.kernels[0].data(), *filter_v = filter.kernels[1].data();
+    for(int i = prewitt_grid.start_h; i < prewitt_grid.end_h; ++i) {
+        for(int j = prewitt_grid.start_w; j < prewitt_grid.end_w; ++j) {
+            if(filter.compass) {
+                int strongest = compass_strength(source, filter, i + origin, j + origin, stride);
+                r.prewitt[i * width + j] = strongest > THRESHOLD ? 255 : 0;
+                r.magnitude[i * width + j] = min(strongest, 65535);
+                continue;
+            }
+            r.prewitt[i * width + j] = prewitt_convolve(source, filter_h, filter_v, i + origin, j + origin, stride, filter.size);
+            r.magnitude[i * width + j] = min(prewitt_gradient(source, filter_h, filter_v, i + origin, j + origin, stride, filter.size), 65535);
+        }
+    }
+    int radius = (window - 1) / 2;
+    for(int i = edge_grid.start_h; i < edge_grid.end_h; ++i) {
+        for(int j = edge_grid.start_w; j < edge_grid.end_w; ++j) {
+            r.edge[i * width + j] = edge_detection_p_and_o(source, stride, i + origin, j + origin, window);
+            int high = 0, low = 255;
+            for(int y = i - radius; y <= i + radius; ++y) {
+                for(int x = j - radius; x <= j + radius; ++x) {
+                    high = max(high, (int)source[(y + origin) * stride + x + origin]);
+                    low = min(low, (int)source[(y + origin) * stride + x + origin]);
+                }
+            }
+            r.window_max[i * width + j] = high;
+            r.window_min[i * width + j] = low;
+        }
+    }
+    return r;
+}
+
+// Sweep planes against the reference: Prewitt is an edge where the gradient
+// exceeds t, P&O where min < t <= max of the window.
+static void check_sweeps(threshold_sweep &prewitt, threshold_sweep &edge, const reference &r, int width, int height, const string &context) {
+    vector<int> plane((size_t)width * height), expected((size_t)width * height);
+    for(size_t k = 0; k < prewitt.thresholds.size(); ++k) {
+        int t = prewitt.thresholds[k];
+        string at = " at threshold " + to_string(t);
+        long long count = 0;
+        for(size_t p = 0; p < expected.size(); ++p) {
+            expected[p] = r.magnitude[p] > t ? 255 : 0;
+            count += expected[p] != 0;
+        }
+        prewitt.planes[k].to_pixels(plane.data(), width, 0, 0, width, height);
+        compare("prewitt sweep" + at, plane.data(), expected.data(), width, height, context);
+        compare_count("prewitt sweep count" + at, prewitt.counts[k], count, context);
+        count = 0;
+        for(size_t p = 0; p < expected.size(); ++p) {
+            expected[p] = r.window_min[p] < t && t <= r.window_max[p] ? 255 : 0;
+            count += expected[p] != 0;
+        }
+        edge.planes[k].to_pixels(plane.data(), width, 0, 0, width, height);
+        compare("edge sweep" + at, plane.data(), expected.data(), width, height, context);
+        compare_count("edge sweep count" + at, edge.counts[k], count, context);
+    }
+}
+
+// Every variant over the interior grids, no padding.
+template<typename T>
+static void check_unpadded(Detector &d, const vector<T> &input, const gradient_filter &filter, int window, const vector<int> &thresholds,
+                           int width, int height, const string &context) {
+    int prewitt_halo = (filter.size - 1) / 2, edge_halo = (window - 1) / 2, halo = max(prewitt_halo, edge_halo);
+    pixel_grid prewitt_grid = {prewitt_halo, width - prewitt_halo, prewitt_halo, height - prewitt_halo};
+    pixel_grid edge_grid = {edge_halo, width - edge_halo, edge_halo, height - edge_halo};
+    pixel_grid fused_grid = {halo, width - halo, halo, height - halo};
+    reference r = make_reference(input.data(), width, 0, width, height, filter, window, prewitt_grid, edge_grid);
+    reference fused = make_reference(input.data(), width, 0, width, height, filter, window, fused_grid, fused_grid);
+    size_t size = (size_t)width * height;
+    vector<T> output(size), second(size);
+
+    for(kernel_variant v : {KERNEL_SCALAR, KERNEL_SIMD, KERNEL_UNROLLED, KERNEL_SEPARABLE}) {
+        d.set_prewitt_variant(v);
+        for(bool parallel : {false, true}) {
+            fill(output.begin(), output.end(), 0);
+            if(parallel) d.parallel_prewitt(input.data(), output.data(), prewitt_grid);
+            else d.serial_prewitt(input.data(), output.data(), prewitt_grid);
+            compare(string(parallel ? "parallel" : "serial") + " prewitt " + kernel_variant_name(v), output.data(), r.prewitt.data(), width, height, context);
+        }
+    }
+    for(kernel_variant v : {KERNEL_SCALAR, KERNEL_SIMD, KERNEL_RUNNING, KERNEL_BITPLANE}) {
+        d.set_edge_variant(v);
+        for(bool parallel : {false, true}) {
+            fill(output.begin(), output.end(), 0);
+            if(parallel) d.parallel_edge_detection(input.data(), output.data(), edge_grid);
+            else d.serial_edge_detection(input.data(), output.data(), edge_grid);
+            compare(string(parallel ? "parallel" : "serial") + " edge " + kernel_variant_name(v), output.data(), r.edge.data(), width, height, context);
+        }
+    }
+
+    fill(output.begin(), output.end(), 0);
+    fill(second.begin(), second.end(), 0);
+    d.fused_detection(input.data(), output.data(), second.data(), nullptr, fused_grid);
+    compare("fused prewitt", output.data(), fused.prewitt.data(), width, height, context);
+    compare("fused edge", second.data(), fused.edge.data(), width, height, context);
+
+    vector<gradient> magnitude(size, 0);
+    d.prewitt_magnitude(input.data(), magnitude.data(), prewitt_grid);
+    compare("magnitude", magnitude.data(), r.magnitude.data(), width, height, context);
+    vector<int> levels = thresholds;
+    levels.push_back(-1);
+    levels.push_back(65535);
+    for(int t : levels) {
+        vector<int> expected(size);
+        for(size_t p = 0; p < size; ++p) expected[p] = r.magnitude[p] > t ? 255 : 0;
+        d.threshold_magnitude(magnitude.data(), output.data(), t);
+        compare("threshold " + to_string(t), output.data(), expected.data(), width, height, context);
+    }
+
+    threshold_sweep prewitt = make_sweep(thresholds, width, height), edge = make_sweep(thresholds, width, height);
+    d.prewitt_sweep(input.data(), &prewitt, prewitt_grid);
+    d.edge_sweep(input.data(), &edge, edge_grid);
+    check_sweeps(prewitt, edge, r, width, height, context);
+}
+
+// The padded entry points, sharing one pad() of the input, against the
+// reference run on a copy padded by hand.
+template<typename T>
+static void check_padded(Detector &d, const vector<T> &input, const gradient_filter &filter, int window, const vector<int> &thresholds,
+                         int width, int height, border_mode border, int value, const string &context) {
+    int halo = max((filter.size - 1) / 2, (window - 1) / 2), stride = width + 2 * halo;
+    vector<T> source((size_t)stride * (height + 2 * halo));
+    for(int i = -halo; i < height + halo; ++i) {
+        for(int j = -halo; j < width + halo; ++j) {
+            bool outside = i < 0 || j < 0 || i >= height || j >= width;
+            T v = border == BORDER_CONSTANT && outside ? (T)value : input[border_index(i, height, border) * width + border_index(j, width, border)];
+            source[(i + halo) * stride + j + halo] = v;
+        }
+    }
+    pixel_grid grid = {0, width, 0, height};
+    reference r = make_reference(source.data(), stride, halo, width, height, filter, window, grid, grid);
+    size_t size = (size_t)width * height;
+    vector<T> output(size), second(size);
+
+    d.set_border(border, value);
+    const Image<T> padded = d.pad(input.data());
+    for(kernel_variant v : {KERNEL_SCALAR, KERNEL_SIMD, KERNEL_UNROLLED, KERNEL_SEPARABLE}) {
+        d.set_prewitt_variant(v);
+        d.padded_prewitt(padded, output.data(), true);
+        compare(string("padded prewitt ") + kernel_variant_name(v), output.data(), r.prewitt.data(), width, height, context);
+    }
+    for(kernel_variant v : {KERNEL_SCALAR, KERNEL_SIMD, KERNEL_RUNNING, KERNEL_BITPLANE}) {
+        d.set_edge_variant(v);
+        d.padded_edge_detection(padded, output.data(), true);
+        compare(string("padded edge ") + kernel_variant_name(v), output.data(), r.edge.data(), width, height, context);
+    }
+    d.padded_fused_detection(padded, output.data(), second.data(), nullptr);
+    compare("padded fused prewitt", output.data(), r.prewitt.data(), width, height, context);
+    compare("padded fused edge", second.data(), r.edge.data(), width, height, context);
+
+    vector<gradient> magnitude(size);
+    d.padded_prewitt_magnitude(padded, magnitude.data());
+    compare("padded magnitude", magnitude.data(), r.magnitude.data(), width, height, context);
+
+    threshold_sweep prewitt = make_sweep(thresholds, width, height), edge = make_sweep(thresholds, width, height);
+    d.padded_prewitt_sweep(padded, &prewitt);
+    d.padded_edge_sweep(padded, &edge);
+    check_sweeps(prewitt, edge, r, width, height, context);
+    d.set_border(BORDER_NONE, 0);
+}
+
+// Canny from its definition on a copy padded by hand: the full 2-D Gaussian,
+// Sobel, suppression along the quantized direction and a serial flood fill
+// from the strong pixels.
+template<typename T>
+static void check_canny(Detector &d, const vector<T> &input, int width, int height, canny_params params, border_mode border, int value,
+                        const string &context) {
+    vector<int> taps = gaussian_taps(params.sigma);
+    int radius = (taps.size() - 1) / 2;
+    long long norm = 0;
+    for(int tap : taps) norm += tap;
+    norm *= norm;
+    auto source = [&](int y, int x) -> long long {
+        bool outside = y < 0 || x < 0 || y >= height || x >= width;
+        return border == BORDER_CONSTANT && outside ? value : input[border_index(y, height, border) * width + border_index(x, width, border)];
+    };
+
+    // blurred covers the image plus 2 pixels, the gradient plus 1
+    int bw = width + 4, gw = width + 2, gh = height + 2;
+    vector<int> blurred((size_t)bw * (height + 4)), magnitude((size_t)gw * gh), direction((size_t)gw * gh);
+    for(int y = -2; y < height + 2; ++y) {
+        for(int x = -2; x < width + 2; ++x) {
+            long long sum = 0;
+            for(int a = -radius; a <= radius; ++a) {
+                for(int b = -radius; b <= radius; ++b) sum += (long long)taps[a + radius] * taps[b + radius] * source(y + a, x + b);
+            }
+            blurred[(size_t)(y + 2) * bw + x + 2] = (int)((sum + norm / 2) / norm);
+        }
+    }
+    auto blur = [&](int y, int x) { return blurred[(size_t)(y + 2) * bw + x + 2]; };
+    for(int y = -1; y < height + 1; ++y) {
+        for(int x = -1; x < width + 1; ++x) {
+            int gx = blur(y - 1, x + 1) + 2 * blur(y, x + 1) + blur(y + 1, x + 1) - blur(y - 1, x - 1) - 2 * blur(y, x - 1) - blur(y + 1, x - 1);
+            int gy = blur(y + 1, x - 1) + 2 * blur(y + 1, x) + blur(y + 1, x + 1) - blur(y - 1, x - 1) - 2 * blur(y - 1, x) - blur(y - 1, x + 1);
+            long long ax = abs(gx), ay = abs(gy);
+            size_t k = (size_t)(y + 1) * gw + x + 1;
+            magnitude[k] = ax + ay;
+            direction[k] = ay * 10000 <= ax * 4142 ? 0 : (ay * 10000 >= ax * 24142 ? 2 : ((gx > 0) == (gy > 0) ? 1 : 3));
+        }
+    }
+
+    static const int STEP_Y[] = {0, 1, 1, 1}, STEP_X[] = {1, 1, 0, -1};
+    vector<uint8_t> classes((size_t)width * height);
+    vector<int> frontier;
+    for(int y = 0; y < height; ++y) {
+        for(int x = 0; x < width; ++x) {
+            size_t k = (size_t)(y + 1) * gw + x + 1;
+            int m = magnitude[k], dy = STEP_Y[direction[k]], dx = STEP_X[direction[k]];
+            bool peak = m > magnitude[k - dy * gw - dx] && m >= magnitude[k + dy * gw + dx];
+            uint8_t c = !peak || m < params.low ? CANNY_NONE : (m >= params.high ? CANNY_STRONG : CANNY_WEAK);
+            classes[(size_t)y * width + x] = c;
+            if(c == CANNY_STRONG) frontier.push_back(y * width + x);
+        }
+    }
+    while(!frontier.empty()) {
+        int y = frontier.back() / width, x = frontier.back() % width;
+        frontier.pop_back();
+        for(int ny = max(y - 1, 0); ny <= min(y + 1, height - 1); ++ny) {
+            for(int nx = max(x - 1, 0); nx <= min(x + 1, width - 1); ++nx) {
+                if(classes[(size_t)ny * width + nx] != CANNY_WEAK) continue;
+                classes[(size_t)ny * width + nx] = CANNY_STRONG;
+                frontier.push_back(ny * width + nx);
+            }
+        }
+    }
+    vector<int> expected((size_t)width * height);
+    for(size_t k = 0; k < expected.size(); ++k) expected[k] = classes[k] == CANNY_STRONG ? 255 : 0;
+
+    vector<T> output((size_t)width * height);
+    d.set_border(border, value);
+    d.set_canny(params);
+    d.canny_detection(input.data(), output.data());
+    compare("canny", output.data(), expected.data(), width, height, context);
+    d.set_border(BORDER_NONE, 0);
+}
+
+// Smooth ramps with noise of a random strength, so every case has flat areas,
+// strong edges and pixels right at the threshold.
+template<typename T>
+static vector<T> random_image(mt19937 &random, int width, int height) {
+    vector<T> image((size_t)width * height);
+    int noise = NOISE_LEVELS[random() % 4];
+    int step_w = random() % 16, step_h = random() % 16;
+    for(int i = 0; i < height; ++i) {
+        for(int j = 0; j < width; ++j) {
+            int value = (i * step_h + j * step_w) % 256;
+            if(noise > 0) value += (int)(random() % noise) - noise / 2;
+            image[(size_t)i * width + j] = min(max(value, 0), 255);
+        }
+    }
+    return image;
+}
+
+template<typename T>
+static void verify_case(Detector &d, mt19937 &random, int number, const vector<string> &filters) {
+    const gradient_filter &filter = *find_filter(filters[random() % filters.size()]);
+    int window = 2 * (random() % 5) + 1;
+    int halo = max((filter.size - 1) / 2, (window - 1) / 2);
+    // every other case is just off a multiple of the widest vector
+    int width = number % 2 == 0 ? 64 * (1 + random() % 3) + 1 + random() % 63 : 2 * halo + 1 + random() % 200;
+    int height = 2 * halo + 1 + random() % 60;
+    vector<T> input = random_image<T>(random, width, height);
+
+    vector<int> thresholds = {THRESHOLD};
+    for(int k = random() % 5; k > 0; --k) thresholds.push_back((int)(random() % 600));
+
+    d.set_image_width(width);
+    d.set_image_height(height);
+    d.set_filter(filter.name);
+    d.set_area((window - 1) / 2);
+    d.set_magnitude_norm(NORM_L1);
+    d.set_grain(1 + random() % 4000);
+    range_kind range = (range_kind)(random() % 3);
+    partitioner_kind partitioner = (partitioner_kind)(random() % 4);
+    bool tiled = random() % 2 == 0;
+    tile_shape tile = {1 + (int)(random() % 80), 1 + (int)(random() % 40)};
+    d.set_range(range);
+    d.set_partitioner(partitioner);
+    d.set_tiled(tiled);
+    d.set_tile_shape(tile);
+    border_mode border = (border_mode)(1 + random() % 3);
+    int border_value = random() % 256;
+    static const double SIGMAS[] = {0.6, 1.0, 1.4, 2.0};
+    canny_params canny = {SIGMAS[random() % 4], (int)(random() % 200), 0};
+    canny.high = canny.low + random() % 400;
+
+    for(int isa = ISA_SCALAR; isa <= simd_detect_isa(); ++isa) {
+        simd_set_isa((simd_isa)isa);
+        ostringstream context;
+        context << "case " << number << ", " << (sizeof(T) == 1 ? "pixel" : "int") << " " << width << "x" << height << ", " << filter.name
+                << ", window " << window << ", " << simd_isa_name((simd_isa)isa) << ", " << RANGE_NAMES[range] << "/" << PARTITIONER_NAMES[partitioner]
+                << ", grain " << d.get_grain();
+        if(tiled) context << ", tiles " << tile.width << "x" << tile.height;
+        check_unpadded(d, input, filter, window, thresholds, width, height, context.str());
+        context << ", border " << BORDER_NAMES[border];
+        check_padded(d, input, filter, window, thresholds, width, height, border, border_value, context.str());
+    }
+    // Canny has no per-ISA kernels
+    ostringstream context;
+    context << "case " << number << ", " << (sizeof(T) == 1 ? "pixel" : "int") << " " << width << "x" << height << ", sigma " << canny.sigma
+            << ", thresholds " << canny.low << "/" << canny.high << ", " << RANGE_NAMES[range] << "/" << PARTITIONER_NAMES[partitioner]
+            << ", grain " << d.get_grain() << ", tiles " << tile.width << "x" << tile.height << ", border " << BORDER_NAMES[border];
+    check_canny(d, input, width, height, canny, border, border_value, context.str());
+}
+
+// Known answers independent of the reference: a vertical step from 0 to 100
+// gives 900 under Kirsch (east mask 3 * 500 - 2 * 300), where the largest
+// |Gd| would be 1500 from the west mask, and 400 under Robinson (Sobel).
+static void check_known_answers(Detector &d) {
+    const pixel step[] = {0, 100, 100, 0, 100, 100, 0, 100, 100};
+    d.set_image_width(3);
+    d.set_image_height(3);
+    for(pair<const char *, int> known : {pair<const char *, int>{"kirsch", 900}, {"robinson", 400}}) {
+        gradient magnitude[9] = {};
+        d.set_filter(known.first);
+        d.prewitt_magnitude(step, magnitude, pixel_grid{1, 2, 1, 2});
+        compare(string(known.first) + " step response", &magnitude[4], &known.second, 1, 1, "3x3 step");
+    }
+}
+
+// Cases alternate between int and pixel buffers; the same seed replays the same cases.
+int verify_kernels(int cases, unsigned seed) {
+    mt19937 random(seed);
+    vector<string> filters = filter_names();
+    simd_isa active = simd_active_isa();
+    comparisons = 0;
+    failures = 0;
+    Detector d;
+    check_known_answers(d);
+    for(int number = 0; number < cases; ++number) {
+        if(number % 2 == 0) verify_case<int>(d, random, number, filters);
+        else verify_case<pixel>(d, random, number, filters);
+    }
+    simd_set_isa(active);
+    cout << "Verify: " << cases << " cases, " << comparisons << " comparisons, " << failures << " failures (seed " << seed << ")." << endl;
+    return failures;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Randomized differential check of every kernel variant, ISA, decomposition
+// and border mode against the scalar reference (prewitt_convolve,
+// edge_detection_p_and_o, prewitt_gradient, the plain window min/max, every
+// compass direction and Canny written out from its definition).
+// Each failed comparison prints the first mismatching pixel; the number of
+// failures is returned.
+int verify_kernels(int, unsigned);
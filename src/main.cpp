@@ -1,9 +1,47 @@
-#include <iostream>
-#include "detector/detector.h"
-
-int main()
-{
-    Detector d;
-    d.start_detector();
-    return 0;
-} 
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "detector/detector.h"
+#include "detector/verify.h"
+#include "trace/trace.h"
+#include "trace/counters.h"
+
+// ImageProcessing                   run every detector on ../resources/color.bmp
+// ImageProcessing --autotune [WxH]  measure this machine and write the tuning profile
+// ImageProcessing --verify [N] [S]  check every kernel variant against the scalar reference
+// EDGE_TRACE=trace.json ImageProcessing  also write a Chrome trace of every stage
+// EDGE_COUNTERS=1 ImageProcessing        also report perf counters per stage
+int main(int argc, char **argv)
+{
+    if(argc > 1 && std::string(argv[1]) == "--autotune") {
+        std::vector<std::pair<int, int>> sizes;
+        for(int i = 2; i < argc; ++i) {
+            int width, height;
+            if(sscanf(argv[i], "%dx%d", &width, &height) != 2 || width < 16 || height < 16) {
+                std::cout << "ERROR: image size must be WxH, at least 16x16!" << std::endl;
+                return 1;
+            }
+            sizes.push_back({width, height});
+        }
+        if(sizes.empty()) sizes = {{640, 480}, {1280, 720}, {1920, 1080}};
+        tuning_profile profile = autotune(sizes, {"prewitt3", "prewitt5"}, {1, 2});
+        if(!save_tuning(tuning_path(), profile)) return 1;
+        std::cout << "Tuning profile written to " << tuning_path() << std::endl;
+        return 0;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--verify") {
+        int cases = argc > 2 ? atoi(argv[2]) : 200;
+        unsigned seed = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1;
+        if(cases <= 0) {
+            std::cout << "ERROR: number of cases must be positive!" << std::endl;
+            return 1;
+        }
+        return verify_kernels(cases, seed) == 0 ? 0 : 1;
+    }
+    counters_start();
+    Detector d;
+    d.start_detector();
+    counters_report();
+    return trace_dump() ? 0 : 1;
+} 
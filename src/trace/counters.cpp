@@ -0,0 +1,189 @@
+#include "counters.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <tbb/task_scheduler_observer.h>
+
+using namespace std;
+
+const bool counters_enabled = getenv("EDGE_COUNTERS") != nullptr;
+
+static const char *COUNTER_NAMES[COUNTER_KINDS] = {"task ms", "cycles", "instructions", "LLC misses", "L1D misses", "branch misses"};
+
+// task-clock is a software event and leads the group, so a machine without a
+// PMU (most VMs) still gets CPU time.
+static perf_event_attr counter_attr(counter_kind kind) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    const uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    switch(kind) {
+        case COUNTER_TASK_CLOCK: attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_TASK_CLOCK; break;
+        case COUNTER_CYCLES: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case COUNTER_INSTRUCTIONS: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case COUNTER_LLC_MISSES: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        case COUNTER_L1D_MISSES: attr.type = PERF_TYPE_HW_CACHE; attr.config = l1d_read_miss; break;
+        default: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    }
+    return attr;
+}
+
+struct counter_group {
+    int fds[COUNTER_KINDS];
+    uint64_t ids[COUNTER_KINDS];
+};
+
+struct stage_totals {
+    long long calls;
+    counter_values sum;
+};
+
+static mutex counters_lock;
+static vector<unique_ptr<counter_group>> groups;
+static map<string, stage_totals> stages;
+static vector<string> stage_order;
+static bool started = false;
+static int open_errors[COUNTER_KINDS];
+
+static long perf_event_open(perf_event_attr *attr, int group) {
+    return syscall(SYS_perf_event_open, attr, 0, -1, group, 0);
+}
+
+// Opens the calling thread's group; members the kernel refuses are left out.
+static void open_group() {
+    static thread_local bool opened = false;
+    if(opened) return;
+    opened = true;
+    unique_ptr<counter_group> group = make_unique<counter_group>();
+    for(int k = 0; k < COUNTER_KINDS; ++k) {
+        perf_event_attr attr = counter_attr((counter_kind)k);
+        int leader = k == 0 ? -1 : group->fds[0];
+        group->fds[k] = (k == 0 || leader >= 0) ? perf_event_open(&attr, leader) : -1;
+        if(group->fds[k] < 0) {
+            int error = errno;
+            lock_guard<mutex> guard(counters_lock);
+            if(open_errors[k] == 0) open_errors[k] = error;
+            continue;
+        }
+        ioctl(group->fds[k], PERF_EVENT_IOC_ID, &group->ids[k]);
+    }
+    if(group->fds[0] < 0) return;
+    lock_guard<mutex> guard(counters_lock);
+    groups.push_back(move(group));
+}
+
+class counter_observer : public tbb::task_scheduler_observer {
+    public:
+        counter_observer() { observe(true); }
+        void on_scheduler_entry(bool) override { open_group(); }
+};
+
+static int paranoid_level() {
+    ifstream file("/proc/sys/kernel/perf_event_paranoid");
+    int level = -100;
+    file >> level;
+    return level;
+}
+
+// Call once from the main thread before any detector work.
+bool counters_start() {
+    if(!counters_enabled || started) return started;
+    open_group();
+    if(groups.empty()) {
+        cout << "Counters unavailable: " << strerror(open_errors[0]) << " (perf_event_paranoid " << paranoid_level() << ")" << endl;
+        return false;
+    }
+    for(int k = 1; k < COUNTER_KINDS; ++k) {
+        if(open_errors[k] != 0) cout << "Counter " << COUNTER_NAMES[k] << " unavailable: " << strerror(open_errors[k]) << endl;
+    }
+    static counter_observer observer;
+    started = true;
+    return true;
+}
+
+bool counters_active() {
+    return started;
+}
+
+// Sum over every thread's group, each value scaled up when the kernel had to
+// multiplex the group.
+counter_values counters_read() {
+    counter_values total;
+    for(int k = 0; k < COUNTER_KINDS; ++k) {
+        total.valid[k] = false;
+        total.value[k] = 0;
+    }
+    lock_guard<mutex> guard(counters_lock);
+    for(const unique_ptr<counter_group> &group : groups) {
+        uint64_t buffer[3 + 2 * COUNTER_KINDS];
+        if(read(group->fds[0], buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(uint64_t))) continue;
+        uint64_t count = buffer[0], enabled = buffer[1], running = buffer[2];
+        double scale = running > 0 ? (double)enabled / running : 1;
+        for(uint64_t n = 0; n < count; ++n) {
+            uint64_t value = buffer[3 + 2 * n], id = buffer[4 + 2 * n];
+            for(int k = 0; k < COUNTER_KINDS; ++k) {
+                if(group->fds[k] < 0 || group->ids[k] != id) continue;
+                total.valid[k] = true;
+                total.value[k] += value * scale;
+            }
+        }
+    }
+    return total;
+}
+
+void counters_add(const char *stage, const counter_values &begin, const counter_values &end) {
+    lock_guard<mutex> guard(counters_lock);
+    auto found = stages.find(stage);
+    if(found == stages.end()) {
+        stage_totals empty = {0, {}};
+        for(int k = 0; k < COUNTER_KINDS; ++k) empty.sum.valid[k] = true;
+        found = stages.emplace(stage, empty).first;
+        stage_order.push_back(stage);
+    }
+    stage_totals &totals = found->second;
+    totals.calls++;
+    for(int k = 0; k < COUNTER_KINDS; ++k) {
+        totals.sum.valid[k] = totals.sum.valid[k] && begin.valid[k] && end.valid[k];
+        totals.sum.value[k] += end.value[k] - begin.value[k];
+    }
+}
+
+// Stages nest (pixelsToBitmap includes WriteToFile), figures are inclusive.
+void counters_report() {
+    if(!started) return;
+    lock_guard<mutex> guard(counters_lock);
+    cout << "Counters over " << groups.size() << " threads:" << endl;
+    cout << left << setw(32) << "stage" << right << setw(6) << "calls";
+    for(int k = 0; k < COUNTER_KINDS; ++k) cout << setw(15) << COUNTER_NAMES[k];
+    cout << setw(7) << "IPC" << endl;
+    for(const string &name : stage_order) {
+        const stage_totals &totals = stages[name];
+        cout << left << setw(32) << name << right << setw(6) << totals.calls << fixed << setprecision(0);
+        for(int k = 0; k < COUNTER_KINDS; ++k) {
+            if(!totals.sum.valid[k]) cout << setw(15) << "n/a";
+            else if(k == COUNTER_TASK_CLOCK) cout << setw(15) << setprecision(2) << totals.sum.value[k] / 1e6 << setprecision(0);
+            else cout << setw(15) << totals.sum.value[k];
+        }
+        bool ipc = totals.sum.valid[COUNTER_CYCLES] && totals.sum.valid[COUNTER_INSTRUCTIONS] && totals.sum.value[COUNTER_CYCLES] > 0;
+        if(ipc) cout << setw(7) << setprecision(2) << totals.sum.value[COUNTER_INSTRUCTIONS] / totals.sum.value[COUNTER_CYCLES];
+        else cout << setw(7) << "n/a";
+        cout.unsetf(ios::fixed);
+        cout << endl;
+    }
+}
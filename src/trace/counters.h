@@ -0,0 +1,40 @@
+#pragma once
+
+// Per-stage counters from perf_event_open, enabled by setting EDGE_COUNTERS.
+// Every thread that runs detector work opens one counter group (the main
+// thread at counters_start, workers when they join the default task arena); a
+// counter_region reads and sums all groups on entry and exit, so a stage's
+// figures include the work of every thread. Events the kernel refuses are
+// reported as n/a; without perf access at all the regions do nothing.
+
+enum counter_kind { COUNTER_TASK_CLOCK, COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_LLC_MISSES, COUNTER_L1D_MISSES, COUNTER_BRANCH_MISSES, COUNTER_KINDS };
+
+struct counter_values {
+    bool valid[COUNTER_KINDS];
+    double value[COUNTER_KINDS];
+};
+
+extern const bool counters_enabled;
+
+bool counters_start();
+bool counters_active();
+counter_values counters_read();
+void counters_add(const char *, const counter_values &, const counter_values &);
+void counters_report();
+
+// name must outlive the report, in practice a string literal.
+class counter_region {
+    private:
+        const char *name;
+        bool active;
+        counter_values begin;
+
+    public:
+        explicit counter_region(const char *name) : name(name), active(counters_enabled && counters_active()) {
+            if(active) begin = counters_read();
+        }
+        ~counter_region() { if(active) counters_add(name, begin, counters_read()); }
+
+        counter_region(const counter_region &) = delete;
+        counter_region &operator=(const counter_region &) = delete;
+};
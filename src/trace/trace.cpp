@@ -0,0 +1,96 @@
+#include "trace.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+const bool trace_enabled = getenv("EDGE_TRACE") != nullptr;
+
+struct trace_event {
+    const char *name;
+    int64_t start;
+    int64_t duration;
+    pixel_grid tile;
+    bool has_tile;
+};
+
+struct trace_buffer {
+    int thread;
+    long os_thread;
+    vector<trace_event> events;
+};
+
+static mutex registry_lock;
+
+static vector<unique_ptr<trace_buffer>> &registry() {
+    static vector<unique_ptr<trace_buffer>> buffers;
+    return buffers;
+}
+
+// Registered once per thread; the registry owns the buffer so TBB workers
+// can exit before the dump.
+static trace_buffer *local_buffer() {
+    static thread_local trace_buffer *buffer = nullptr;
+    if(buffer == nullptr) {
+        lock_guard<mutex> guard(registry_lock);
+        registry().push_back(make_unique<trace_buffer>());
+        buffer = registry().back().get();
+        buffer->thread = registry().size() - 1;
+        buffer->os_thread = syscall(SYS_gettid);
+        buffer->events.reserve(1024);
+    }
+    return buffer;
+}
+
+int64_t trace_now() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_record(const char *name, int64_t start, const pixel_grid *tile) {
+    trace_event event = {name, start, trace_now() - start, tile ? *tile : pixel_grid(), tile != nullptr};
+    local_buffer()->events.push_back(event);
+}
+
+// Complete ("X") events in microseconds, one track per thread. Call once the
+// traced work has finished.
+bool trace_dump() {
+    if(!trace_enabled) return true;
+    const char *path = getenv("EDGE_TRACE");
+    ofstream file(path);
+    if(!file) {
+        cout << "ERROR: cannot write trace " << path << "!" << endl;
+        return false;
+    }
+    lock_guard<mutex> guard(registry_lock);
+    int64_t origin = INT64_MAX;
+    for(const unique_ptr<trace_buffer> &buffer : registry()) {
+        for(const trace_event &e : buffer->events) origin = min(origin, e.start);
+    }
+    int pid = getpid();
+    file << fixed << setprecision(3) << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    bool first = true;
+    for(const unique_ptr<trace_buffer> &buffer : registry()) {
+        file << (first ? "" : ",") << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << buffer->thread
+             << ", \"args\": {\"name\": \"thread " << buffer->thread << " (tid " << buffer->os_thread << ")\"}}";
+        first = false;
+        for(const trace_event &e : buffer->events) {
+            file << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": " << pid << ", \"tid\": " << buffer->thread
+                 << ", \"ts\": " << (e.start - origin) / 1000.0 << ", \"dur\": " << e.duration / 1000.0;
+            if(e.has_tile) {
+                file << ", \"args\": {\"x\": [" << e.tile.start_w << ", " << e.tile.end_w << "], \"y\": [" << e.tile.start_h << ", " << e.tile.end_h
+                     << "], \"os_tid\": " << buffer->os_thread << "}";
+            }
+            file << "}";
+        }
+    }
+    file << "\n]}\n";
+    return (bool)file;
+}
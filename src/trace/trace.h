@@ -0,0 +1,32 @@
+#include <cstdint>
+#include "../detector/grid.h"
+
+#pragma once
+
+// Scoped trace spans, dumped as Chrome trace JSON (chrome://tracing or
+// ui.perfetto.dev). Tracing is on when EDGE_TRACE names the output file.
+// Every thread appends to its own buffer, so recording takes no lock; when
+// tracing is off a span costs one load and a branch.
+
+extern const bool trace_enabled;
+
+int64_t trace_now();
+void trace_record(const char *, int64_t, const pixel_grid *);
+bool trace_dump();
+
+// name must outlive the trace, in practice a string literal.
+class trace_span {
+    private:
+        const char *name;
+        int64_t start;
+        pixel_grid tile;
+        bool has_tile;
+
+    public:
+        explicit trace_span(const char *name) : name(name), start(trace_enabled ? trace_now() : 0), tile(), has_tile(false) {}
+        trace_span(const char *name, pixel_grid tile) : name(name), start(trace_enabled ? trace_now() : 0), tile(tile), has_tile(true) {}
+        ~trace_span() { if(start != 0) trace_record(name, start, has_tile ? &tile : nullptr); }
+
+        trace_span(const trace_span &) = delete;
+        trace_span &operator=(const trace_span &) = delete;
+};